@@ -0,0 +1,191 @@
+/* Copyright 2020 Esri
+ *
+ * Licensed under the Apache License Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "RulePackageStreamAdaptor.h"
+
+#include "Codec/Adaptor/RulePackageRegistry.h"
+
+#include <cwchar>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+const std::wstring RULE_PACKAGE_STREAM_ADAPTOR_ID = L"com.esri.prt.unreal.RulePackageStreamAdaptor";
+const std::wstring RULE_PACKAGE_STREAM_ADAPTOR_NAME = L"Unreal Rule Package Stream Adaptor";
+const std::wstring RULE_PACKAGE_STREAM_ADAPTOR_DESCRIPTION = L"Reads rule packages from memory registered by Vitruvio.";
+
+using RulePackageData = std::vector<uint8_t>;
+using RulePackageDataPtr = std::shared_ptr<const RulePackageData>;
+
+class RulePackageRegistry
+{
+public:
+	uint64_t add(const uint8_t* data, size_t size)
+	{
+		RulePackageDataPtr rulePackageData = std::make_shared<const RulePackageData>(data, data + size);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		const uint64_t id = nextId++;
+		rulePackages.emplace(id, std::move(rulePackageData));
+		return id;
+	}
+
+	void remove(uint64_t id)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		rulePackages.erase(id);
+	}
+
+	RulePackageDataPtr find(uint64_t id) const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		const auto it = rulePackages.find(id);
+		return it != rulePackages.end() ? it->second : RulePackageDataPtr();
+	}
+
+private:
+	mutable std::mutex mutex;
+	std::unordered_map<uint64_t, RulePackageDataPtr> rulePackages;
+	uint64_t nextId = 1;
+};
+
+RulePackageRegistry& getRulePackageRegistry()
+{
+	static RulePackageRegistry registry;
+	return registry;
+}
+
+bool parseRulePackageId(const prtx::URIPtr& uri, uint64_t& id)
+{
+	// Expected path: "/<id>.rpk"
+	const std::wstring path = uri->getPath();
+	const wchar_t* begin = path.c_str();
+	while (*begin == L'/')
+		++begin;
+
+	wchar_t* end = nullptr;
+	id = std::wcstoull(begin, &end, 10);
+	return end != begin;
+}
+
+// Read-only, seekable stream buffer over the registered data. Keeps the data alive while the stream is open.
+class RulePackageStreamBuffer final : public std::streambuf
+{
+public:
+	explicit RulePackageStreamBuffer(RulePackageDataPtr data) : data(std::move(data))
+	{
+		char* begin = const_cast<char*>(reinterpret_cast<const char*>(this->data->data()));
+		setg(begin, begin, begin + this->data->size());
+	}
+
+protected:
+	pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override
+	{
+		off_type base = 0;
+		if (dir == std::ios_base::cur)
+			base = gptr() - eback();
+		else if (dir == std::ios_base::end)
+			base = egptr() - eback();
+		return seekpos(pos_type(base + off), which);
+	}
+
+	pos_type seekpos(pos_type pos, std::ios_base::openmode which) override
+	{
+		const off_type offset = static_cast<off_type>(pos);
+		if (!(which & std::ios_base::in) || offset < 0 || offset > egptr() - eback())
+			return pos_type(off_type(-1));
+
+		setg(eback(), eback() + offset, egptr());
+		return pos;
+	}
+
+private:
+	RulePackageDataPtr data;
+};
+
+class RulePackageStream final : public std::istream
+{
+public:
+	explicit RulePackageStream(RulePackageDataPtr data) : std::istream(nullptr), buffer(std::move(data))
+	{
+		rdbuf(&buffer);
+	}
+
+private:
+	RulePackageStreamBuffer buffer;
+};
+
+} // namespace
+
+extern "C"
+{
+	CODEC_EXPORTS_API uint64_t registerRulePackage(const uint8_t* data, size_t size)
+	{
+		return getRulePackageRegistry().add(data, size);
+	}
+
+	CODEC_EXPORTS_API void unregisterRulePackage(uint64_t id)
+	{
+		getRulePackageRegistry().remove(id);
+	}
+}
+
+std::istream* RulePackageStreamAdaptor::createStream(prtx::URIPtr uri) const
+{
+	uint64_t id = 0;
+	if (!parseRulePackageId(uri, id))
+		return nullptr;
+
+	RulePackageDataPtr data = getRulePackageRegistry().find(id);
+	if (!data)
+		return nullptr;
+
+	return new RulePackageStream(std::move(data));
+}
+
+void RulePackageStreamAdaptor::destroyStream(std::istream* stream) const
+{
+	delete stream;
+}
+
+RulePackageStreamAdaptorFactory* RulePackageStreamAdaptorFactory::createInstance()
+{
+	return new RulePackageStreamAdaptorFactory();
+}
+
+const std::wstring& RulePackageStreamAdaptorFactory::getID() const
+{
+	return RULE_PACKAGE_STREAM_ADAPTOR_ID;
+}
+
+const std::wstring& RulePackageStreamAdaptorFactory::getName() const
+{
+	return RULE_PACKAGE_STREAM_ADAPTOR_NAME;
+}
+
+const std::wstring& RulePackageStreamAdaptorFactory::getDescription() const
+{
+	return RULE_PACKAGE_STREAM_ADAPTOR_DESCRIPTION;
+}
+
+bool RulePackageStreamAdaptorFactory::canHandleURI(prtx::URIPtr uri) const
+{
+	return uri && uri->isValid() && uri->getScheme() == RULE_PACKAGE_URI_SCHEME;
+}
@@ -0,0 +1,61 @@
+/* Copyright 2020 Esri
+ *
+ * Licensed under the Apache License Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#pragma warning(push)
+#pragma warning(disable : 4263 4264)
+#include "prtx/Singleton.h"
+#include "prtx/StreamAdaptor.h"
+#include "prtx/StreamAdaptorFactory.h"
+#include "prtx/URI.h"
+#pragma warning(pop)
+
+#include "Codec/CodecMain.h"
+
+#include <iosfwd>
+#include <string>
+
+/**
+ * Serves rule packages which have been registered in memory (see registerRulePackage) to PRT.
+ */
+class RulePackageStreamAdaptor final : public prtx::StreamAdaptor
+{
+public:
+	RulePackageStreamAdaptor() = default;
+	~RulePackageStreamAdaptor() override = default;
+
+	std::istream* createStream(prtx::URIPtr uri) const override;
+	void destroyStream(std::istream* stream) const override;
+};
+
+class RulePackageStreamAdaptorFactory final : public prtx::StreamAdaptorFactory, public prtx::Singleton<RulePackageStreamAdaptorFactory>
+{
+public:
+	static RulePackageStreamAdaptorFactory* createInstance();
+
+	RulePackageStreamAdaptorFactory() = default;
+	~RulePackageStreamAdaptorFactory() override = default;
+
+	RulePackageStreamAdaptor* create() const override
+	{
+		return new RulePackageStreamAdaptor();
+	}
+
+	const std::wstring& getID() const override;
+	const std::wstring& getName() const override;
+	const std::wstring& getDescription() const override;
+	bool canHandleURI(prtx::URIPtr uri) const override;
+};
@@ -15,8 +15,11 @@
 
 #include "CodecMain.h"
 
+#include "Adaptor/RulePackageStreamAdaptor.h"
 #include "Encoder/UnrealGeometryEncoder.h"
 
+#include "Codec/Encoder/IUnrealCallbacks.h"
+
 #include "prtx/ExtensionManager.h"
 
 // TODO get version when we automatically download PRT from github and set in build script
@@ -31,6 +34,7 @@ extern "C"
 	CODEC_EXPORTS_API void registerExtensionFactories(prtx::ExtensionManager* manager)
 	{
 		manager->addFactory(UnrealGeometryEncoderFactory::createInstance());
+		manager->addFactory(RulePackageStreamAdaptorFactory::instance());
 	}
 
 	CODEC_EXPORTS_API void unregisterExtensionFactories(prtx::ExtensionManager* /*manager*/) {}
@@ -44,4 +48,9 @@ extern "C"
 	{
 		return VERSION_MINOR;
 	}
+
+	CODEC_EXPORTS_API uint32_t getUnrealCallbacksVersion()
+	{
+		return UNREAL_CALLBACKS_VERSION;
+	}
 }
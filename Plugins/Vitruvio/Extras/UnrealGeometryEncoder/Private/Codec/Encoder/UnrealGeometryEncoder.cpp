@@ -20,6 +20,7 @@
 #pragma warning(push)
 #pragma warning(disable : 4263 4264)
 #include "prtx/Attributable.h"
+#include "prtx/BoundingBox.h"
 #include "prtx/Exception.h"
 #include "prtx/ExtensionManager.h"
 #include "prtx/GenerateContext.h"
@@ -34,10 +35,13 @@
 
 #include <algorithm>
 #include <cassert>
+#include <map>
 #include <memory>
 #include <numeric>
 #include <set>
 #include <sstream>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace
@@ -48,14 +52,51 @@ constexpr const wchar_t* UNREAL_GEOMETRY_ENCODER_NAME = L"Unreal Encoder";
 constexpr const wchar_t* UNREAL_GEOMETRY_ENCODER_DESCRIPTION = L"Encodes geometry into Unreal geometry.";
 
 constexpr const wchar_t* EO_EMIT_ATTRIBUTES = L"emitAttributes";
+constexpr const wchar_t* EO_EMIT_ATTRIBUTES_ONCE = L"emitAttributesOnce";
 constexpr const wchar_t* EO_EMIT_MATERIALS = L"emitMaterials";
 constexpr const wchar_t* EO_EMIT_REPORTS = L"emitReports";
+constexpr const wchar_t* EO_EMIT_UNREAL_SPACE_FLOAT = L"emitUnrealSpaceFloat";
+constexpr const wchar_t* EO_TRIANGULATE = L"triangulate";
+constexpr const wchar_t* EO_SHARE_VERTEX_INDICES = L"shareVertexIndices";
+
+// Merge tolerances used with shared vertex indices (coordinates in meters)
+constexpr float MERGE_TOLERANCE_VERTICES = 1e-4f;
+constexpr float MERGE_TOLERANCE_NORMALS = 1e-3f;
+constexpr float MERGE_TOLERANCE_UVS = 1e-4f;
+
+// Standard conversion from meters (PRT) to centimeters (UE4)
+constexpr double PRT_TO_UE_SCALE = 100.0;
 
 const prtx::DoubleVector EMPTY_UVS;
 const prtx::IndexVector EMPTY_IDX;
 
+// Sizes of all serialized streams, determined by scanning the meshes before anything is copied
+struct GeometrySizes
+{
+	bool sharedIndices = false;
+	uint32_t numCounts = 0;
+	uint32_t numIndices = 0;
+	size_t numCoords = 0;
+	size_t numNormalCoords = 0;
+
+	// Statistics passed to the client together with the mesh
+	prtx::BoundingBox bounds;
+	size_t numTriangles = 0;
+
+	std::vector<size_t> numUVCoords;
+	std::vector<size_t> numUVCounts;
+	std::vector<size_t> numUVIndices;
+
+	uint32_t numUVSets() const
+	{
+		return static_cast<uint32_t>(numUVCoords.size());
+	}
+};
+
+// Collects the geometry in double precision and PRT space
 struct SerializedGeometry
 {
+	GeometrySizes sizes;
 	prtx::DoubleVector coords;
 	prtx::DoubleVector normals;
 	std::vector<uint32_t> faceVertexCounts;
@@ -66,27 +107,61 @@ struct SerializedGeometry
 	std::vector<prtx::IndexVector> uvCounts;
 	std::vector<prtx::IndexVector> uvIndices;
 
-	SerializedGeometry(uint32_t numCounts, uint32_t numIndices, uint32_t uvSets) : uvs(uvSets), uvCounts(uvSets), uvIndices(uvSets)
+	explicit SerializedGeometry(const GeometrySizes& sizes)
+		: sizes(sizes), uvs(sizes.numUVSets()), uvCounts(sizes.numUVSets()), uvIndices(sizes.numUVSets())
+	{
+		coords.reserve(sizes.numCoords);
+		normals.reserve(sizes.numNormalCoords);
+		faceVertexCounts.reserve(sizes.numCounts);
+		vertexIndices.reserve(sizes.numIndices);
+		if (!sizes.sharedIndices)
+			normalIndices.reserve(sizes.numIndices);
+		for (uint32_t uvSet = 0; uvSet < sizes.numUVSets(); uvSet++)
+		{
+			uvs[uvSet].reserve(sizes.numUVCoords[uvSet]);
+			uvCounts[uvSet].reserve(sizes.numUVCounts[uvSet]);
+			uvIndices[uvSet].reserve(sizes.numUVIndices[uvSet]);
+		}
+	}
+
+	void appendCoords(const prtx::DoubleVector& src)
 	{
-		faceVertexCounts.reserve(numCounts);
-		vertexIndices.reserve(numIndices);
-		normalIndices.reserve(numIndices);
+		coords.insert(coords.end(), src.begin(), src.end());
 	}
-};
 
-using AttributeMapNOPtrVector = std::vector<const prt::AttributeMap*>;
+	void appendNormals(const prtx::DoubleVector& src)
+	{
+		normals.insert(normals.end(), src.begin(), src.end());
+	}
 
-struct AttributeMapNOPtrVectorOwner
-{
-	AttributeMapNOPtrVector v;
+	void appendUVs(uint32_t uvSet, const prtx::DoubleVector& src)
+	{
+		uvs[uvSet].insert(uvs[uvSet].end(), src.begin(), src.end());
+	}
 
-	~AttributeMapNOPtrVectorOwner()
+	void appendUVCounts(uint32_t uvSet, const prtx::IndexVector& src)
 	{
-		for (const auto& m : v)
-		{
-			if (m != nullptr)
-				m->destroy();
-		}
+		uvCounts[uvSet].insert(uvCounts[uvSet].end(), src.begin(), src.end());
+	}
+
+	void appendUVIndex(uint32_t uvSet, uint32_t index)
+	{
+		uvIndices[uvSet].push_back(index);
+	}
+
+	void appendFaceVertexCount(uint32_t count)
+	{
+		faceVertexCounts.push_back(count);
+	}
+
+	void appendVertexIndex(uint32_t index)
+	{
+		vertexIndices.push_back(index);
+	}
+
+	void appendNormalIndex(uint32_t index)
+	{
+		normalIndices.push_back(index);
 	}
 };
 
@@ -148,6 +223,24 @@ uint32_t scanValidTextures(const prtx::MaterialPtr& mat)
 		return highestUVSet + 1;
 }
 
+uint32_t scanMeshUVSets(const prtx::GeometryPtr& geometry)
+{
+	uint32_t numUVSets = 0;
+	for (const auto& mesh : geometry->getMeshes())
+		numUVSets = std::max(numUVSets, mesh->getUVSetsCount());
+	return numUVSets;
+}
+
+// The uv sets of a mesh are determined by the textures of its materials. Additional uv sets of the PRT meshes are not used by any texture
+// and are dropped, except for uv set 0 which is needed by the client to compute tangents and lightmap uvs.
+uint32_t scanRequiredUVSets(const prtx::GeometryPtr& geometry, const prtx::MaterialPtrVector& materials)
+{
+	uint32_t numUVSets = std::min(scanMeshUVSets(geometry), 1u);
+	for (const auto& mat : materials)
+		numUVSets = std::max(numUVSets, scanValidTextures(mat));
+	return numUVSets;
+}
+
 // use shape name by default for the actor and if the instance originates from a file we use the file name for better readability
 std::wstring createInstanceName(const prtx::EncodePreparator::FinalizedInstance& fi)
 {
@@ -173,7 +266,7 @@ std::wstring uriToPath(const prtx::TexturePtr& t)
 
 // we blacklist all CGA-style material attribute keys, see prtx/Material.h
 // clang-format off
-	const std::set<std::wstring> MATERIAL_ATTRIBUTE_BLACKLIST = {
+	const std::unordered_set<std::wstring> MATERIAL_ATTRIBUTE_BLACKLIST = {
 		L"ambient.b",
 		L"ambient.g",
 		L"ambient.r",
@@ -348,6 +441,44 @@ void convertMaterialToAttributeMap(prtx::PRTUtils::AttributeMapBuilderPtr& aBuil
 	}
 }
 
+// Compares materials by content since equal materials are not guaranteed to share the same instance (see prtx/Content.h)
+struct MaterialPtrLess
+{
+	bool operator()(const prtx::MaterialPtr& a, const prtx::MaterialPtr& b) const
+	{
+		return *a < *b;
+	}
+};
+
+// Converts every distinct material of an initial shape only once and forwards it to the client which can then refer to it by id
+class MaterialRegistry
+{
+public:
+	MaterialRegistry(IUnrealCallbacks* cb, size_t isIndex) : cb(cb), isIndex(isIndex), amb(prt::AttributeMapBuilder::create()) {}
+
+	int32_t getMaterialId(const prtx::MaterialPtr& material)
+	{
+		const auto it = materialIds.find(material);
+		if (it != materialIds.end())
+			return it->second;
+
+		const int32_t materialId = static_cast<int32_t>(materialIds.size());
+		convertMaterialToAttributeMap(amb, *material, material->getKeys());
+		const prt::AttributeMap* materialAttributes = amb->createAttributeMapAndReset();
+		cb->addMaterial(isIndex, materialId, materialAttributes);
+		materialAttributes->destroy();
+
+		materialIds.emplace(material, materialId);
+		return materialId;
+	}
+
+private:
+	IUnrealCallbacks* cb;
+	size_t isIndex;
+	prtx::PRTUtils::AttributeMapBuilderPtr amb;
+	std::map<prtx::MaterialPtr, int32_t, MaterialPtrLess> materialIds;
+};
+
 template <typename F>
 void forEachKey(prt::Attributable const* a, F f)
 {
@@ -393,34 +524,241 @@ void forwardGenericAttributes(IUnrealCallbacks* uc, size_t initialShapeIndex, co
 	});
 }
 
-SerializedGeometry serializeGeometry(const prtx::GeometryPtrVector& geometries, const std::vector<prtx::MaterialPtrVector>& materials)
+// Interns the report keys so that every key is only passed once even if it is reported with different types
+class ReportKeys
 {
-	// PASS 1: scan
-	uint32_t numCounts = 0;
-	uint32_t numIndices = 0;
-	uint32_t maxNumUVSets = 0;
-	auto matsIt = materials.cbegin();
+public:
+	uint32_t getKeyIndex(const prtx::StringPtr& key)
+	{
+		const auto it = keyIndices.emplace(*key, static_cast<uint32_t>(keys.size()));
+		if (it.second)
+			keys.push_back(it.first->first.c_str());
+		return it.first->second;
+	}
+
+	const std::vector<const wchar_t*>& getKeys() const
+	{
+		return keys;
+	}
+
+private:
+	std::unordered_map<std::wstring, uint32_t> keyIndices;
+	std::vector<const wchar_t*> keys;
+};
+
+// Forwards the reports of all shapes of the initial shape in a single call. Reports with the same key are summed up (see
+// prtx::SumReportsAccumulator).
+void forwardReports(IUnrealCallbacks* cb, size_t initialShapeIndex, prtx::GenerateContext& context)
+{
+	const prtx::ReportsAccumulatorPtr summarizer{prtx::SumReportsAccumulator::create()};
+	const prtx::ReportingStrategyPtr collector{prtx::AllShapesReportingStrategy::create(context, initialShapeIndex, summarizer)};
+	const prtx::ReportsPtr& reports = collector->getReports();
+	if (!reports)
+		return;
+
+	ReportKeys keys;
+
+	std::vector<uint32_t> boolKeys;
+	std::unique_ptr<bool[]> boolValues(new bool[reports->mBools.size()]);
+	boolKeys.reserve(reports->mBools.size());
+	for (const auto& b : reports->mBools)
+	{
+		boolValues[boolKeys.size()] = b.second;
+		boolKeys.push_back(keys.getKeyIndex(b.first));
+	}
+
+	std::vector<uint32_t> floatKeys;
+	std::vector<double> floatValues;
+	floatKeys.reserve(reports->mFloats.size());
+	floatValues.reserve(reports->mFloats.size());
+	for (const auto& f : reports->mFloats)
+	{
+		floatKeys.push_back(keys.getKeyIndex(f.first));
+		floatValues.push_back(f.second);
+	}
+
+	std::vector<uint32_t> stringKeys;
+	std::vector<const wchar_t*> stringValues;
+	stringKeys.reserve(reports->mStrings.size());
+	stringValues.reserve(reports->mStrings.size());
+	for (const auto& s : reports->mStrings)
+	{
+		stringKeys.push_back(keys.getKeyIndex(s.first));
+		stringValues.push_back(s.second->c_str());
+	}
+
+	cb->addReports(initialShapeIndex, keys.getKeys().data(), keys.getKeys().size(), boolKeys.data(), boolValues.get(), boolKeys.size(),
+				   floatKeys.data(), floatValues.data(), floatKeys.size(), stringKeys.data(), stringValues.data(), stringKeys.size());
+}
+
+// Converts from PRT space (Y up) to Unreal space (Z up). The loop has no dependencies between iterations and gets vectorized by the compiler.
+void convertCoords(float* out, const prtx::DoubleVector& src, double scale)
+{
+	const double* in = src.data();
+	for (size_t i = 0, size = src.size() - src.size() % 3; i < size; i += 3)
+	{
+		out[i] = static_cast<float>(in[i] * scale);
+		out[i + 1] = static_cast<float>(in[i + 2] * scale);
+		out[i + 2] = static_cast<float>(in[i + 1] * scale);
+	}
+}
+
+// Flips the V coordinate since Unreal uses a top left texture origin
+void convertUVs(float* out, const prtx::DoubleVector& src)
+{
+	const double* in = src.data();
+	for (size_t i = 0, size = src.size() - src.size() % 2; i < size; i += 2)
+	{
+		out[i] = static_cast<float>(in[i]);
+		out[i + 1] = static_cast<float>(-in[i + 1]);
+	}
+}
+
+// Writes the geometry converted to single precision and Unreal space directly into the buffers provided by the client
+class UnrealSpaceGeometryWriter
+{
+public:
+	UnrealSpaceGeometryWriter(const UnrealMeshBuffers& buffers, uint32_t uvSets)
+		: buffers(buffers), uvCoordsOffsets(uvSets, 0), uvCountsOffsets(uvSets, 0), uvIndicesOffsets(uvSets, 0)
+	{
+	}
+
+	void appendCoords(const prtx::DoubleVector& src)
+	{
+		convertCoords(buffers.vtx + coordsOffset, src, PRT_TO_UE_SCALE);
+		coordsOffset += src.size();
+	}
+
+	void appendNormals(const prtx::DoubleVector& src)
+	{
+		convertCoords(buffers.nrm + normalsOffset, src, 1.0);
+		normalsOffset += src.size();
+	}
+
+	void appendUVs(uint32_t uvSet, const prtx::DoubleVector& src)
+	{
+		convertUVs(buffers.uvs[uvSet] + uvCoordsOffsets[uvSet], src);
+		uvCoordsOffsets[uvSet] += src.size();
+	}
+
+	void appendUVCounts(uint32_t uvSet, const prtx::IndexVector& src)
+	{
+		std::copy(src.begin(), src.end(), buffers.uvCounts[uvSet] + uvCountsOffsets[uvSet]);
+		uvCountsOffsets[uvSet] += src.size();
+	}
+
+	void appendUVIndex(uint32_t uvSet, uint32_t index)
+	{
+		buffers.uvIndices[uvSet][uvIndicesOffsets[uvSet]++] = index;
+	}
+
+	void appendFaceVertexCount(uint32_t count)
+	{
+		buffers.faceVertexCounts[countsOffset++] = count;
+	}
+
+	void appendVertexIndex(uint32_t index)
+	{
+		buffers.vertexIndices[vertexIndicesOffset++] = index;
+	}
+
+	void appendNormalIndex(uint32_t index)
+	{
+		buffers.normalIndices[normalIndicesOffset++] = index;
+	}
+
+private:
+	const UnrealMeshBuffers& buffers;
+
+	size_t coordsOffset = 0;
+	size_t normalsOffset = 0;
+	size_t countsOffset = 0;
+	size_t vertexIndicesOffset = 0;
+	size_t normalIndicesOffset = 0;
+	std::vector<size_t> uvCoordsOffsets;
+	std::vector<size_t> uvCountsOffsets;
+	std::vector<size_t> uvIndicesOffsets;
+};
+
+GeometrySizes scanGeometry(const prtx::GeometryPtrVector& geometries, uint32_t maxNumUVSets, bool sharedIndices)
+{
+	GeometrySizes sizes;
+	sizes.sharedIndices = sharedIndices;
+
+	// The uv sizes depend on the total number of uv sets since missing uv sets are filled up with uv set 0 (see copyGeometry)
+	sizes.numUVCoords.resize(maxNumUVSets, 0);
+	sizes.numUVCounts.resize(maxNumUVSets, 0);
+	sizes.numUVIndices.resize(maxNumUVSets, 0);
 	for (const auto& geo : geometries)
 	{
-		const prtx::MeshPtrVector& meshes = geo->getMeshes();
-		const prtx::MaterialPtrVector& mats = *matsIt;
-		auto matIt = mats.cbegin();
-		for (const auto& mesh : meshes)
+		for (const auto& mesh : geo->getMeshes())
 		{
-			numCounts += mesh->getFaceCount();
+			sizes.numCounts += mesh->getFaceCount();
 			const auto& vtxCnts = mesh->getFaceVertexCounts();
-			numIndices = std::accumulate(vtxCnts.begin(), vtxCnts.end(), numIndices);
+			sizes.numIndices = std::accumulate(vtxCnts.begin(), vtxCnts.end(), sizes.numIndices);
+			for (const uint32_t vtxCnt : vtxCnts)
+				sizes.numTriangles += (vtxCnt >= 3) ? vtxCnt - 2 : 0;
+			sizes.bounds.add(mesh->getBoundingBox());
 
-			const prtx::MaterialPtr& mat = *matIt;
-			const uint32_t requiredUVSetsByMaterial = scanValidTextures(mat);
-			maxNumUVSets = std::max(maxNumUVSets, std::max(mesh->getUVSetsCount(), requiredUVSetsByMaterial));
-			++matIt;
+			sizes.numCoords += mesh->getVertexCoords().size();
+			sizes.numNormalCoords += mesh->getVertexNormalsCoords().size();
+
+			// With shared indices every uv set has one uv per vertex and there are no separate uv counts and indices
+			if (sharedIndices)
+			{
+				for (uint32_t uvSet = 0; uvSet < maxNumUVSets; uvSet++)
+					sizes.numUVCoords[uvSet] += mesh->getVertexCoords().size() / 3 * 2;
+				continue;
+			}
+
+			const uint32_t numUVSets = mesh->getUVSetsCount();
+			for (uint32_t uvSet = 0; uvSet < maxNumUVSets; uvSet++)
+			{
+				sizes.numUVCounts[uvSet] += mesh->getFaceCount();
+				if (numUVSets == 0)
+					continue;
+
+				const bool hasUVSet = uvSet < numUVSets && !mesh->getUVCoords(uvSet).empty();
+				const uint32_t srcUVSet = hasUVSet ? uvSet : 0;
+				sizes.numUVCoords[uvSet] += mesh->getUVCoords(srcUVSet).size();
+				const prtx::IndexVector& faceUVCounts = mesh->getFaceUVCounts(srcUVSet);
+				sizes.numUVIndices[uvSet] = std::accumulate(faceUVCounts.begin(), faceUVCounts.end(), sizes.numUVIndices[uvSet]);
+			}
 		}
-		++matsIt;
 	}
-	SerializedGeometry sg(numCounts, numIndices, maxNumUVSets);
 
-	// PASS 2: copy
+	return sizes;
+}
+
+// Copies the uv coords of a mesh with shared indices. Missing uv sets are filled up with uv set 0 or with zeros if the mesh has no uvs at all
+// to keep the uvs of all sets indexed by the vertex indices.
+template <typename Output>
+void copySharedUVs(const prtx::MeshPtr& mesh, uint32_t maxNumUVSets, Output& out)
+{
+	const size_t numVertexUVCoords = mesh->getVertexCoords().size() / 3 * 2;
+	const uint32_t numUVSets = mesh->getUVSetsCount();
+	const prtx::DoubleVector& uvs0 = (numUVSets > 0) ? mesh->getUVCoords(0) : EMPTY_UVS;
+
+	prtx::DoubleVector zeroUVs;
+	for (uint32_t uvSet = 0; uvSet < maxNumUVSets; uvSet++)
+	{
+		const prtx::DoubleVector& uvs = (uvSet < numUVSets) ? mesh->getUVCoords(uvSet) : EMPTY_UVS;
+		const auto& src = uvs.empty() ? uvs0 : uvs;
+		if (src.size() == numVertexUVCoords)
+		{
+			out.appendUVs(uvSet, src);
+		}
+		else
+		{
+			zeroUVs.resize(numVertexUVCoords, 0.0);
+			out.appendUVs(uvSet, zeroUVs);
+		}
+	}
+}
+
+template <typename Output>
+void copyGeometry(const prtx::GeometryPtrVector& geometries, uint32_t maxNumUVSets, bool sharedIndices, Output& out)
+{
 	uint32_t vertexIndexBase = 0u;
 	uint32_t normalIndexBase = 0u;
 	std::vector<uint32_t> uvIndexBases(maxNumUVSets, 0u);
@@ -431,11 +769,29 @@ SerializedGeometry serializeGeometry(const prtx::GeometryPtrVector& geometries,
 		{
 			// append points
 			const prtx::DoubleVector& verts = mesh->getVertexCoords();
-			sg.coords.insert(sg.coords.end(), verts.begin(), verts.end());
+			out.appendCoords(verts);
 
 			// append normals
 			const prtx::DoubleVector& norms = mesh->getVertexNormalsCoords();
-			sg.normals.insert(sg.normals.end(), norms.begin(), norms.end());
+			out.appendNormals(norms);
+
+			if (sharedIndices)
+			{
+				assert(norms.size() == verts.size());
+				copySharedUVs(mesh, maxNumUVSets, out);
+
+				for (uint32_t fi = 0, faceCount = mesh->getFaceCount(); fi < faceCount; ++fi)
+				{
+					const uint32_t vtxCnt = mesh->getFaceVertexCount(fi);
+					out.appendFaceVertexCount(vtxCnt);
+					const uint32_t* vtxIdx = mesh->getFaceVertexIndices(fi);
+					for (uint32_t vi = 0; vi < vtxCnt; vi++)
+						out.appendVertexIndex(vertexIndexBase + vtxIdx[vi]);
+				}
+
+				vertexIndexBase += (uint32_t)verts.size() / 3u;
+				continue;
+			}
 
 			// append uv sets (uv coords, counts, indices) with special cases:
 			// - if mesh has no uv sets but maxNumUVSets is > 0, insert "0" uv face counts to keep in sync
@@ -446,19 +802,17 @@ SerializedGeometry serializeGeometry(const prtx::GeometryPtrVector& geometries,
 			if (DBG)
 				log_debug("-- mesh: numUVSets = %1%") % numUVSets;
 
-			for (uint32_t uvSet = 0; uvSet < sg.uvs.size(); uvSet++)
+			for (uint32_t uvSet = 0; uvSet < maxNumUVSets; uvSet++)
 			{
 				// append texture coordinates
 				const prtx::DoubleVector& uvs = (uvSet < numUVSets) ? mesh->getUVCoords(uvSet) : EMPTY_UVS;
 				const auto& src = uvs.empty() ? uvs0 : uvs;
-				auto& tgt = sg.uvs[uvSet];
-				tgt.insert(tgt.end(), src.begin(), src.end());
+				out.appendUVs(uvSet, src);
 
 				// append uv face counts
 				const prtx::IndexVector& faceUVCounts = (uvSet < numUVSets && !uvs.empty()) ? mesh->getFaceUVCounts(uvSet) : faceUVCounts0;
 				assert(faceUVCounts.size() == mesh->getFaceCount());
-				auto& tgtCnts = sg.uvCounts[uvSet];
-				tgtCnts.insert(tgtCnts.end(), faceUVCounts.begin(), faceUVCounts.end());
+				out.appendUVCounts(uvSet, faceUVCounts);
 				if (DBG)
 					log_debug("   -- uvset %1%: face counts size = %2%") % uvSet % faceUVCounts.size();
 
@@ -471,7 +825,7 @@ SerializedGeometry serializeGeometry(const prtx::GeometryPtrVector& geometries,
 					if (DBG)
 						log_debug("      fi %1%: faceUVCnt = %2%, faceVtxCnt = %3%") % fi % faceUVCnt % mesh->getFaceVertexCount(fi);
 					for (uint32_t vi = 0; vi < faceUVCnt; vi++)
-						sg.uvIndices[uvSet].push_back(uvIndexBases[uvSet] + faceUVIdx[vi]);
+						out.appendUVIndex(uvSet, uvIndexBases[uvSet] + faceUVIdx[vi]);
 				}
 
 				uvIndexBases[uvSet] += static_cast<uint32_t>(src.size()) / 2;
@@ -481,13 +835,13 @@ SerializedGeometry serializeGeometry(const prtx::GeometryPtrVector& geometries,
 			for (uint32_t fi = 0, faceCount = mesh->getFaceCount(); fi < faceCount; ++fi)
 			{
 				const uint32_t vtxCnt = mesh->getFaceVertexCount(fi);
-				sg.faceVertexCounts.push_back(vtxCnt);
+				out.appendFaceVertexCount(vtxCnt);
 				const uint32_t* vtxIdx = mesh->getFaceVertexIndices(fi);
 				const uint32_t* nrmIdx = mesh->getFaceVertexNormalIndices(fi);
 				for (uint32_t vi = 0; vi < vtxCnt; vi++)
 				{
-					sg.vertexIndices.push_back(vertexIndexBase + vtxIdx[vi]);
-					sg.normalIndices.push_back(normalIndexBase + nrmIdx[vi]);
+					out.appendVertexIndex(vertexIndexBase + vtxIdx[vi]);
+					out.appendNormalIndex(normalIndexBase + nrmIdx[vi]);
 				}
 			}
 
@@ -495,22 +849,24 @@ SerializedGeometry serializeGeometry(const prtx::GeometryPtrVector& geometries,
 			normalIndexBase += (uint32_t)norms.size() / 3u;
 		} // for all meshes
 	}	  // for all geometries
-
-	return sg;
 }
 
-void encodeMesh(IUnrealCallbacks* cb, const SerializedGeometry& sg, wchar_t const* name, int32_t prototypeIndex, const std::wstring& uri,
-				prtx::GeometryPtrVector geometries, std::vector<prtx::MaterialPtrVector> materials)
+SerializedGeometry serializeGeometry(const prtx::GeometryPtrVector& geometries, uint32_t numUVSets, bool sharedIndices)
 {
-	auto puvs = toPtrVec(sg.uvs);
-	auto puvCounts = toPtrVec(sg.uvCounts);
-	auto puvIndices = toPtrVec(sg.uvIndices);
+	// PASS 1: scan
+	const GeometrySizes sizes = scanGeometry(geometries, numUVSets, sharedIndices);
+	SerializedGeometry sg(sizes);
 
-	std::vector<uint32_t> faceRanges;
-	AttributeMapNOPtrVectorOwner matAttrMaps;
+	// PASS 2: copy
+	copyGeometry(geometries, sizes.numUVSets(), sharedIndices, sg);
 
+	return sg;
+}
+
+void collectMaterials(const prtx::GeometryPtrVector& geometries, const std::vector<prtx::MaterialPtrVector>& materials, MaterialRegistry& materialRegistry,
+					  std::vector<uint32_t>& faceRanges, std::vector<int32_t>& materialIds)
+{
 	auto matIt = materials.cbegin();
-	prtx::PRTUtils::AttributeMapBuilderPtr amb(prt::AttributeMapBuilder::create());
 	for (const auto& geo : geometries)
 	{
 		const prtx::MeshPtrVector& meshes = geo->getMeshes();
@@ -520,22 +876,106 @@ void encodeMesh(IUnrealCallbacks* cb, const SerializedGeometry& sg, wchar_t cons
 			const prtx::MeshPtr& m = meshes.at(mi);
 			const prtx::MaterialPtr& mat = matIt->at(mi);
 
-			convertMaterialToAttributeMap(amb, *(mat.get()), mat->getKeys());
-			matAttrMaps.v.push_back(amb->createAttributeMapAndReset());
+			materialIds.push_back(materialRegistry.getMaterialId(mat));
 			faceRanges.push_back(m->getFaceCount());
 		}
 
 		++matIt;
 	}
+}
+
+// The statistics are in the same space as the vertices passed to addMesh
+UnrealMeshStats getMeshStats(const GeometrySizes& sizes, const std::vector<int32_t>& materialIds, bool unrealSpace)
+{
+	UnrealMeshStats stats;
+	if (sizes.bounds.isModified())
+	{
+		const prtx::DoubleVector& min = sizes.bounds.getMin();
+		const prtx::DoubleVector& max = sizes.bounds.getMax();
+		const double scale = unrealSpace ? PRT_TO_UE_SCALE : 1.0;
+		for (size_t axis = 0; axis < 3; axis++)
+		{
+			// Unreal space swaps the Y and Z axes (see convertCoords)
+			const size_t srcAxis = (unrealSpace && axis > 0) ? 3 - axis : axis;
+			stats.boundsMin[axis] = min[srcAxis] * scale;
+			stats.boundsMax[axis] = max[srcAxis] * scale;
+		}
+		stats.boundsRadius = sizes.bounds.getDiameter() * 0.5 * scale;
+	}
+
+	stats.numVertices = sizes.numCoords / 3;
+	stats.numTriangles = sizes.numTriangles;
+	stats.numMaterials = std::set<int32_t>(materialIds.begin(), materialIds.end()).size();
+	stats.sharedIndices = sizes.sharedIndices;
+	return stats;
+}
+
+void encodeMesh(IUnrealCallbacks* cb, size_t isIndex, const SerializedGeometry& sg, wchar_t const* name, int32_t prototypeIndex, const std::wstring& uri,
+				const prtx::GeometryPtrVector& geometries, const std::vector<prtx::MaterialPtrVector>& materials, MaterialRegistry& materialRegistry)
+{
+	auto puvs = toPtrVec(sg.uvs);
+	auto puvCounts = toPtrVec(sg.uvCounts);
+	auto puvIndices = toPtrVec(sg.uvIndices);
 
-	cb->addMesh(name, prototypeIndex, uri.c_str(), sg.coords.data(), sg.coords.size(), sg.normals.data(), sg.normals.size(),
-				sg.faceVertexCounts.data(), sg.faceVertexCounts.size(), sg.vertexIndices.data(), sg.vertexIndices.size(), sg.normalIndices.data(),
-				sg.normalIndices.size(),
+	// With shared indices the normals are indexed by the vertex indices (see IUnrealCallbacks::addMesh)
+	const std::vector<uint32_t>& normalIndices = sg.sizes.sharedIndices ? sg.vertexIndices : sg.normalIndices;
+
+	std::vector<uint32_t> faceRanges;
+	std::vector<int32_t> materialIds;
+	collectMaterials(geometries, materials, materialRegistry, faceRanges, materialIds);
+
+	const UnrealMeshStats stats = getMeshStats(sg.sizes, materialIds, false);
+	cb->addMesh(isIndex, name, prototypeIndex, uri.c_str(), sg.coords.data(), sg.coords.size(), sg.normals.data(), sg.normals.size(),
+				sg.faceVertexCounts.data(), sg.faceVertexCounts.size(), sg.vertexIndices.data(), sg.vertexIndices.size(), normalIndices.data(),
+				normalIndices.size(),
 
 				puvs.first.data(), puvs.second.data(), puvCounts.first.data(), puvCounts.second.data(), puvIndices.first.data(),
 				puvIndices.second.data(), sg.uvs.size(),
 
-				faceRanges.data(), faceRanges.size(), matAttrMaps.v.empty() ? nullptr : matAttrMaps.v.data());
+				faceRanges.data(), faceRanges.size(), materialIds.empty() ? nullptr : materialIds.data(), stats);
+}
+
+// Two phase encoding: the client allocates the buffers for the sizes found in the scan and the geometry is then written directly into them
+void encodeUnrealSpaceMesh(IUnrealCallbacks* cb, size_t isIndex, wchar_t const* name, int32_t prototypeIndex, const std::wstring& uri,
+						   const prtx::GeometryPtrVector& geometries, const std::vector<prtx::MaterialPtrVector>& materials,
+						   MaterialRegistry& materialRegistry, uint32_t numUVSets, bool sharedIndices)
+{
+	// PASS 1: scan
+	const GeometrySizes sizes = scanGeometry(geometries, numUVSets, sharedIndices);
+
+	UnrealMeshSizes meshSizes;
+	meshSizes.vtxSize = sizes.numCoords;
+	meshSizes.nrmSize = sizes.numNormalCoords;
+	meshSizes.faceVertexCountsSize = sizes.numCounts;
+	meshSizes.indicesSize = sizes.numIndices;
+	meshSizes.uvsSizes = sizes.numUVCoords.data();
+	meshSizes.uvCountsSizes = sizes.numUVCounts.data();
+	meshSizes.uvIndicesSizes = sizes.numUVIndices.data();
+	meshSizes.uvSets = sizes.numUVSets();
+	meshSizes.sharedIndices = sharedIndices;
+
+	UnrealMeshBuffers buffers;
+	if (!cb->allocateMesh(isIndex, name, prototypeIndex, uri.c_str(), meshSizes, buffers))
+		return;
+
+	// PASS 2: copy
+	UnrealSpaceGeometryWriter writer(buffers, sizes.numUVSets());
+	copyGeometry(geometries, sizes.numUVSets(), sharedIndices, writer);
+
+	std::vector<uint32_t> faceRanges;
+	std::vector<int32_t> materialIds;
+	collectMaterials(geometries, materials, materialRegistry, faceRanges, materialIds);
+
+	const UnrealMeshStats stats = getMeshStats(sizes, materialIds, true);
+
+	// With shared indices the normals are indexed by the vertex indices (see IUnrealCallbacks::addMesh)
+	const uint32_t* normalIndices = sharedIndices ? buffers.vertexIndices : buffers.normalIndices;
+	cb->addMesh(isIndex, name, prototypeIndex, uri.c_str(), buffers.vtx, meshSizes.vtxSize, buffers.nrm, meshSizes.nrmSize, buffers.faceVertexCounts,
+				meshSizes.faceVertexCountsSize, buffers.vertexIndices, meshSizes.indicesSize, normalIndices, meshSizes.indicesSize,
+
+				buffers.uvs, meshSizes.uvsSizes, buffers.uvCounts, meshSizes.uvCountsSizes, buffers.uvIndices, meshSizes.uvIndicesSizes, meshSizes.uvSets,
+
+				faceRanges.data(), faceRanges.size(), materialIds.empty() ? nullptr : materialIds.data(), stats);
 }
 } // namespace
 
@@ -558,6 +998,8 @@ void UnrealGeometryEncoder::encode(prtx::GenerateContext& context, size_t initia
 	IUnrealCallbacks* cb = static_cast<IUnrealCallbacks*>(getCallbacks());
 
 	const bool emitAttrs = getOptions()->getBool(EO_EMIT_ATTRIBUTES);
+	const bool emitAttrsOnce = getOptions()->getBool(EO_EMIT_ATTRIBUTES_ONCE);
+	const bool emitReports = getOptions()->getBool(EO_EMIT_REPORTS);
 
 	prtx::DefaultNamePreparator namePrep;
 	prtx::NamePreparator::NamespacePtr nsMesh = namePrep.newNamespace();
@@ -568,41 +1010,102 @@ void UnrealGeometryEncoder::encode(prtx::GenerateContext& context, size_t initia
 	prtx::ReportsAccumulatorPtr reportsAccumulator{prtx::WriteFirstReportsAccumulator::create()};
 	prtx::ReportingStrategyPtr reportsCollector{prtx::LeafShapeReportingStrategy::create(context, initialShapeIndex, reportsAccumulator)};
 	prtx::LeafIteratorPtr li = prtx::LeafIterator::create(context, initialShapeIndex);
+	prtx::ShapePtr lastShape;
 	for (prtx::ShapePtr shape = li->getNext(); shape; shape = li->getNext())
 	{
+		if (cb->isCanceled(initialShapeIndex))
+			return;
+
 		prtx::ReportsPtr r = reportsCollector->getReports(shape->getID());
 		encPrep->add(context.getCache(), shape, initialShape.getAttributeMap(), r);
 
 		// get final values of generic attributes
-		if (emitAttrs)
+		if (emitAttrs && !emitAttrsOnce)
 			forwardGenericAttributes(cb, initialShapeIndex, initialShape, shape);
+		lastShape = shape;
 	}
 
-	const prtx::EncodePreparator::PreparationFlags PREP_FLAGS =
+	// The client keeps the last value it receives for every attribute. Forwarding the attributes of the last leaf shape only therefore gives
+	// the same result with a single call per attribute and initial shape.
+	if (emitAttrs && emitAttrsOnce && lastShape)
+		forwardGenericAttributes(cb, initialShapeIndex, initialShape, lastShape);
+
+	if (emitReports)
+		forwardReports(cb, initialShapeIndex, context);
+
+	// If triangulated all faces have three vertices and the vertex indices of each material range form a ready to use triangle index buffer
+	const bool triangulate = getOptions()->getBool(EO_TRIANGULATE);
+
+	// Shared indices replicate vertices only where attributes really differ, merging them within the tolerances first keeps the replication
+	// to the actual hard edges and uv seams
+	const bool shareVertexIndices = getOptions()->getBool(EO_SHARE_VERTEX_INDICES);
+	prtx::EncodePreparator::PreparationFlags prepFlags =
 		prtx::EncodePreparator::PreparationFlags()
 			.instancing(true)
 			.mergeByMaterial(true)
-			.triangulate(false)
+			.triangulate(triangulate)
 			.processHoles(prtx::HoleProcessor::TRIANGULATE_FACES_WITH_HOLES)
 			.mergeVertices(true)
 			.cleanupVertexNormals(true)
 			.cleanupUVs(true)
 			.processVertexNormals(prtx::VertexNormalProcessor::SET_MISSING_TO_FACE_NORMALS)
 			.indexSharing(prtx::EncodePreparator::PreparationFlags::INDICES_SEPARATE_FOR_ALL_VERTEX_ATTRIBUTES);
+	if (shareVertexIndices)
+	{
+		prepFlags.indexSharing(prtx::EncodePreparator::PreparationFlags::INDICES_SAME_FOR_ALL_VERTEX_ATTRIBUTES)
+			.mergeToleranceVertices(MERGE_TOLERANCE_VERTICES)
+			.mergeToleranceNormals(MERGE_TOLERANCE_NORMALS)
+			.mergeToleranceUVs(MERGE_TOLERANCE_UVS);
+	}
+
+	if (cb->isCanceled(initialShapeIndex))
+		return;
 
 	prtx::EncodePreparator::InstanceVector instances;
-	encPrep->fetchFinalizedInstances(instances, PREP_FLAGS);
-	convertGeometry(initialShape, instances, cb);
+	encPrep->fetchFinalizedInstances(instances, prepFlags);
+	convertGeometry(initialShapeIndex, initialShape, instances, cb);
 }
 
-void UnrealGeometryEncoder::convertGeometry(const prtx::InitialShape& initialShape, const prtx::EncodePreparator::InstanceVector& instances,
+void UnrealGeometryEncoder::convertGeometry(size_t initialShapeIndex, const prtx::InitialShape& initialShape, const prtx::EncodePreparator::InstanceVector& instances,
 											IUnrealCallbacks* cb) const
 {
 	std::set<int> serializedPrototypes;
+	MaterialRegistry materialRegistry(cb, initialShapeIndex);
+
+	const bool emitUnrealSpaceFloat = getOptions()->getBool(EO_EMIT_UNREAL_SPACE_FLOAT);
+	const bool shareVertexIndices = getOptions()->getBool(EO_SHARE_VERTEX_INDICES);
+	auto serializeAndEncodeMesh = [&](const prtx::GeometryPtrVector& geometries, const std::vector<prtx::MaterialPtrVector>& materials,
+									  uint32_t numUVSets, wchar_t const* name, int32_t prototypeIndex, const std::wstring& uri) {
+		if (emitUnrealSpaceFloat)
+		{
+			encodeUnrealSpaceMesh(cb, initialShapeIndex, name, prototypeIndex, uri, geometries, materials, materialRegistry, numUVSets,
+								  shareVertexIndices);
+		}
+		else
+		{
+			const SerializedGeometry sg = serializeGeometry(geometries, numUVSets, shareVertexIndices);
+			encodeMesh(cb, initialShapeIndex, sg, name, prototypeIndex, uri, geometries, materials, materialRegistry);
+		}
+	};
+
+	// A prototype mesh is shared by all its instances and needs the uv sets of all materials its instances can override it with. Prototypes
+	// with a uri are cached by uri on the client and reused by later initial shapes with other materials, so they keep all their uv sets.
+	std::map<int32_t, uint32_t> prototypeUVSets;
+	for (const auto& inst : instances)
+	{
+		if (inst.getPrototypeIndex() != -1)
+		{
+			const prtx::GeometryPtr& instGeom = inst.getGeometry();
+			uint32_t& numUVSets = prototypeUVSets[inst.getPrototypeIndex()];
+			numUVSets = std::max(numUVSets, scanRequiredUVSets(instGeom, inst.getMaterials()));
+			if (!instGeom->getURI()->wstring().empty())
+				numUVSets = std::max(numUVSets, scanMeshUVSets(instGeom));
+		}
+	}
 
 	prtx::GeometryPtrVector geometries;
 	std::vector<prtx::MaterialPtrVector> materials;
-	prtx::PRTUtils::AttributeMapBuilderPtr instanceMatAmb(prt::AttributeMapBuilder::create());
+	uint32_t numUVSets = 0;
 	for (const auto& inst : instances)
 	{
 		if (inst.getPrototypeIndex() != -1)
@@ -610,42 +1113,38 @@ void UnrealGeometryEncoder::convertGeometry(const prtx::InitialShape& initialSha
 			const prtx::MaterialPtrVector& instMaterials = inst.getMaterials();
 			const prtx::GeometryPtr& instGeom = inst.getGeometry();
 
-			AttributeMapNOPtrVectorOwner instMaterialsAttributeMap;
-
 			if (serializedPrototypes.find(inst.getPrototypeIndex()) == serializedPrototypes.end())
 			{
 				const std::wstring uri = instGeom->getURI()->wstring();
-				const SerializedGeometry sg = serializeGeometry({instGeom}, {instMaterials});
 				const std::wstring instName = createInstanceName(inst);
 
-				encodeMesh(cb, sg, instName.c_str(), inst.getPrototypeIndex(), uri, {instGeom}, {instMaterials});
+				serializeAndEncodeMesh({instGeom}, {instMaterials}, prototypeUVSets[inst.getPrototypeIndex()], instName.c_str(),
+									   inst.getPrototypeIndex(), uri);
 
 				serializedPrototypes.insert(inst.getPrototypeIndex());
 			}
 
 			const prtx::MeshPtrVector& meshes = instGeom->getMeshes();
+			std::vector<int32_t> instMaterialIds;
+			instMaterialIds.reserve(meshes.size());
 			for (size_t mi = 0; mi < meshes.size(); mi++)
 			{
-				const prtx::MaterialPtr& mat = instMaterials[mi];
-
-				convertMaterialToAttributeMap(instanceMatAmb, *(mat.get()), mat->getKeys());
-				instMaterialsAttributeMap.v.push_back(instanceMatAmb->createAttributeMapAndReset());
+				instMaterialIds.push_back(materialRegistry.getMaterialId(instMaterials[mi]));
 			}
 
-			cb->addInstance(inst.getPrototypeIndex(), inst.getTransformation().data(), instMaterialsAttributeMap.v.data(),
-							instMaterialsAttributeMap.v.size());
+			cb->addInstance(initialShapeIndex, inst.getPrototypeIndex(), inst.getTransformation().data(), instMaterialIds.data(), instMaterialIds.size());
 		}
 		else
 		{
 			geometries.push_back(inst.getGeometry());
 			materials.push_back(inst.getMaterials());
+			numUVSets = std::max(numUVSets, scanRequiredUVSets(inst.getGeometry(), inst.getMaterials()));
 		}
 	}
 
 	if (geometries.size() > 0)
 	{
-		const SerializedGeometry sg = serializeGeometry(geometries, materials);
-		encodeMesh(cb, sg, initialShape.getName(), -1, L"", geometries, materials);
+		serializeAndEncodeMesh(geometries, materials, numUVSets, initialShape.getName(), -1, L"");
 	}
 
 	if (DBG)
@@ -665,7 +1164,12 @@ UnrealGeometryEncoderFactory* UnrealGeometryEncoderFactory::createInstance()
 
 	prtx::PRTUtils::AttributeMapBuilderPtr amb(prt::AttributeMapBuilder::create());
 	amb->setBool(EO_EMIT_ATTRIBUTES, true);
+	amb->setBool(EO_EMIT_ATTRIBUTES_ONCE, true);
 	amb->setBool(EO_EMIT_MATERIALS, true);
+	amb->setBool(EO_EMIT_REPORTS, false);
+	amb->setBool(EO_EMIT_UNREAL_SPACE_FLOAT, false);
+	amb->setBool(EO_TRIANGULATE, false);
+	amb->setBool(EO_SHARE_VERTEX_INDICES, false);
 	encoderInfoBuilder.setDefaultOptions(amb->createAttributeMap());
 
 	return new UnrealGeometryEncoderFactory(encoderInfoBuilder.create());
@@ -53,7 +53,7 @@ public:
 	void finish(prtx::GenerateContext& context) override;
 
 private:
-	void convertGeometry(const prtx::InitialShape& initialShape, const prtx::EncodePreparator::InstanceVector& instances,
+	void convertGeometry(size_t initialShapeIndex, const prtx::InitialShape& initialShape, const prtx::EncodePreparator::InstanceVector& instances,
 						 IUnrealCallbacks* callbacks) const;
 };
 
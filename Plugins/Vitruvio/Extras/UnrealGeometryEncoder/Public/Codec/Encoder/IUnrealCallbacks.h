@@ -6,12 +6,76 @@
 
 constexpr const wchar_t* UNREAL_GEOMETRY_ENCODER_ID = L"UnrealGeometryEncoder";
 
+/**
+ * Version of the IUnrealCallbacks interface. Must be incremented whenever the virtual functions or the structs below change, since an
+ * encoder library built against a different version would call the wrong functions. The encoder library exports its version as
+ * getUnrealCallbacksVersion (see GetUnrealCallbacksVersionFunc). Libraries which do not export it predate versioning.
+ */
+constexpr uint32_t UNREAL_CALLBACKS_VERSION = 3;
+
+using GetUnrealCallbacksVersionFunc = uint32_t (*)();
+
+/**
+ * Number of elements of each geometry stream of a mesh, see IUnrealCallbacks::allocateMesh. The uv arrays contain uvSets entries.
+ */
+struct UnrealMeshSizes
+{
+	size_t vtxSize = 0;
+	size_t nrmSize = 0;
+	size_t faceVertexCountsSize = 0;
+	size_t indicesSize = 0; // same for vertex and normal indices
+
+	size_t const* uvsSizes = nullptr;
+	size_t const* uvCountsSizes = nullptr;
+	size_t const* uvIndicesSizes = nullptr;
+	size_t uvSets = 0;
+
+	// If set, normals and uvs are indexed by the vertex indices and the normal, uv count and uv index buffers are not written
+	bool sharedIndices = false;
+};
+
+/**
+ * Writable buffers owned by the client into which the encoder writes the geometry of a mesh, see IUnrealCallbacks::allocateMesh. The uv
+ * arrays contain one buffer per uv set.
+ */
+struct UnrealMeshBuffers
+{
+	float* vtx = nullptr;
+	float* nrm = nullptr;
+	uint32_t* faceVertexCounts = nullptr;
+	uint32_t* vertexIndices = nullptr;
+	uint32_t* normalIndices = nullptr;
+
+	float* const* uvs = nullptr;
+	uint32_t* const* uvCounts = nullptr;
+	uint32_t* const* uvIndices = nullptr;
+};
+
+/**
+ * Statistics of a mesh which are determined by the encoder before the geometry is copied, see IUnrealCallbacks::addMesh. The bounds are in
+ * the same space as the vertex coordinates of the mesh.
+ */
+struct UnrealMeshStats
+{
+	double boundsMin[3] = {0.0, 0.0, 0.0};
+	double boundsMax[3] = {0.0, 0.0, 0.0};
+	double boundsRadius = 0.0; // radius of the bounding sphere around the center of the bounds
+
+	size_t numVertices = 0;
+	size_t numTriangles = 0; // number of triangles after triangulating all faces
+	size_t numMaterials = 0; // number of distinct materials
+
+	// Set if the normals and uvs are indexed by the vertex indices, see IUnrealCallbacks::addMesh
+	bool sharedIndices = false;
+};
+
 class IUnrealCallbacks : public prt::Callbacks
 {
 public:
 	~IUnrealCallbacks() override = default;
 
 	/**
+	 * @param isIndex initial shape index (relative to the initialShapes array in the generate() call)
 	 * @param name initial shape name, optionally used to create primitive groups on output
 	 * @param prototypeId the id of the prototype or -1 of not cached
 	 * @param vtx vertex coordinate array
@@ -24,12 +88,16 @@ public:
 	 * @param vertexIndicesSize vertex attribute index array
 	 * @param uvs array of texture coordinate arrays (same indexing as vertices per uv set)
 	 * @param uvsSizes lengths of uv arrays per uv set
+	 *
 	 * @param faceRanges ranges for materials and reports
-	 * @param materials contains faceRangesSize-1 attribute maps (all materials must have an identical set of keys and
-	 * types)
+	 * @param materialIds contains faceRangesSize ids of materials previously added with addMaterial
+	 * @param stats bounds and element counts of the mesh
+	 *
+	 * If stats.sharedIndices is set (encoder option "shareVertexIndices"), normalIndices points to vertexIndices and the normals and all uv
+	 * sets contain exactly one entry per vertex. The uv counts and uv indices are empty in this case.
 	 */
 	// clang-format off
-	virtual void addMesh(const wchar_t* name,
+	virtual void addMesh(size_t isIndex, const wchar_t* name,
 	                     int32_t prototypeId, const wchar_t* uri,
 	                     const double* vtx, size_t vtxSize,
 	                     const double* nrm, size_t nrmSize,
@@ -43,20 +111,102 @@ public:
 	                     size_t uvSets,
 
                          const uint32_t* faceRanges, size_t faceRangesSize,
-	                     const prt::AttributeMap** materials
+	                     const int32_t* materialIds,
+	                     const UnrealMeshStats& stats
 	) = 0;
 	// clang-format on
 
 	/**
-	 * Add a new instance with the given id, transform and an optional set of overriding attributes for this instance
+	 * First phase of encoding a mesh if the encoder option "emitUnrealSpaceFloat" is set. The client provides buffers of at least the given
+	 * sizes into which the encoder then directly writes the geometry in Unreal space before calling the float addMesh with these buffers.
+	 * The buffers have to stay valid until addMesh for the same initial shape has returned.
 	 *
+	 * @param isIndex initial shape index (relative to the initialShapes array in the generate() call)
+	 * @param name initial shape name, optionally used to create primitive groups on output
+	 * @param prototypeId the id of the prototype or -1 of not cached
+	 * @param uri the uri of the prototype or empty if not cached
+	 * @param sizes the number of elements of each geometry stream
+	 * @param buffers the buffers to be filled in by the client
+	 * @return false if the client already has this mesh (e.g. from a cache). The encoder then skips the mesh and does not call addMesh.
+	 */
+	virtual bool allocateMesh(size_t isIndex, const wchar_t* name, int32_t prototypeId, const wchar_t* uri, const UnrealMeshSizes& sizes,
+							  UnrealMeshBuffers& buffers) = 0;
+
+	/**
+	 * Same as the double precision addMesh but called if the encoder option "emitUnrealSpaceFloat" is set. The geometry has already been
+	 * converted to Unreal space by the encoder: coordinates are in centimeters with Z up, normals are Z up and the V coordinate of the uvs is
+	 * flipped. The coordinate arrays can therefore be copied as they are. The arrays are the buffers provided by the client in allocateMesh.
+	 */
+	// clang-format off
+	virtual void addMesh(size_t isIndex, const wchar_t* name,
+	                     int32_t prototypeId, const wchar_t* uri,
+	                     const float* vtx, size_t vtxSize,
+	                     const float* nrm, size_t nrmSize,
+	                     const uint32_t* faceVertexCounts, size_t faceVertexCountsSize,
+	                     const uint32_t* vertexIndices, size_t vertexIndicesSize,
+	                     const uint32_t* normalIndices, size_t normalIndicesSize,
+
+	                     float const* const* uvs, size_t const* uvsSizes,
+	                     uint32_t const* const* uvCounts, size_t const* uvCountsSizes,
+	                     uint32_t const* const* uvIndices, size_t const* uvIndicesSizes,
+	                     size_t uvSets,
+
+	                     const uint32_t* faceRanges, size_t faceRangesSize,
+	                     const int32_t* materialIds,
+	                     const UnrealMeshStats& stats
+	) = 0;
+	// clang-format on
+
+	/**
+	 * Add a new instance with the given id, transform and an optional set of overriding materials for this instance
+	 *
+	 * @param isIndex initial shape index (relative to the initialShapes array in the generate() call)
 	 * @param prototypeId the id of the prorotype. An @ref addMesh call with the specified prorotypeId will be called before
 	 *                    the call to addInstance
 	 * @param transform the transformation matrix of this instance
-	 * @param instanceMaterial override materials for this instance
+	 * @param instanceMaterialIds ids of the override materials for this instance, previously added with addMaterial
 	 * @param numInstanceMaterials number of instance material overrides. Is either 0 or is equal to the number
 	 *                             of materials of the original mesh (by prototypeId)
 	 */
-	virtual void addInstance(int32_t prototypeId, const double* transform, const prt::AttributeMap** instanceMaterial,
+	virtual void addInstance(size_t isIndex, int32_t prototypeId, const double* transform, const int32_t* instanceMaterialIds,
 							 size_t numInstanceMaterials) = 0;
+
+	/**
+	 * Add a material which is referenced by its id from subsequent addMesh and addInstance calls. Every distinct material is only added
+	 * once per initial shape.
+	 *
+	 * @param isIndex initial shape index (relative to the initialShapes array in the generate() call)
+	 * @param materialId the id of the material, unique per initial shape
+	 * @param material the material attributes, only valid during this call
+	 */
+	virtual void addMaterial(size_t isIndex, int32_t materialId, const prt::AttributeMap* material) = 0;
+
+	/**
+	 * Add the CGA reports of all shapes of an initial shape, reports with the same key are summed up. Called once per initial shape if the
+	 * encoder option "emitReports" is set. Every key is only passed once and is referenced by its index from the reports of all types.
+	 *
+	 * @param isIndex initial shape index (relative to the initialShapes array in the generate() call)
+	 * @param keys the report keys
+	 * @param keysSize number of report keys
+	 * @param boolKeys index into keys for every bool report
+	 * @param boolValues values of the bool reports
+	 * @param boolsSize number of bool reports
+	 * @param floatKeys index into keys for every float report
+	 * @param floatValues values of the float reports
+	 * @param floatsSize number of float reports
+	 * @param stringKeys index into keys for every string report
+	 * @param stringValues values of the string reports
+	 * @param stringsSize number of string reports
+	 */
+	virtual void addReports(size_t isIndex, const wchar_t* const* keys, size_t keysSize, const uint32_t* boolKeys, const bool* boolValues,
+							size_t boolsSize, const uint32_t* floatKeys, const double* floatValues, size_t floatsSize, const uint32_t* stringKeys,
+							const wchar_t* const* stringValues, size_t stringsSize) = 0;
+
+	/**
+	 * Queried by the encoder while encoding an initial shape. Allows the client to stop encoding results which are no longer needed.
+	 *
+	 * @param isIndex initial shape index (relative to the initialShapes array in the generate() call)
+	 * @return true if the result for the given initial shape is no longer needed
+	 */
+	virtual bool isCanceled(size_t isIndex) const = 0;
 };
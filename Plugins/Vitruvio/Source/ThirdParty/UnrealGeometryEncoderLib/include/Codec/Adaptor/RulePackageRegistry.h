@@ -0,0 +1,47 @@
+// Copyright © 2017-2020 Esri R&D Center Zurich. All rights reserved.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// The encoder library includes Codec/CodecMain.h first which exports the functions below
+#ifndef CODEC_EXPORTS_API
+#ifdef _WIN32
+#define CODEC_EXPORTS_API __declspec(dllimport)
+#else
+#define CODEC_EXPORTS_API
+#endif
+#endif
+
+/**
+ * URI scheme of rule packages which have been registered in memory, eg. "vitruviorpk:/42.rpk". Such URIs can directly be
+ * passed to prt::createResolveMap and are served by the RulePackageStreamAdaptor without touching the file system.
+ */
+constexpr const wchar_t* RULE_PACKAGE_URI_SCHEME = L"vitruviorpk";
+
+/**
+ * Signatures of the functions below. Clients resolve them from the loaded encoder library at runtime so that an outdated library which
+ * does not export them is reported instead of failing to link or load.
+ */
+using RegisterRulePackageFunc = uint64_t (*)(const uint8_t* data, size_t size);
+using UnregisterRulePackageFunc = void (*)(uint64_t id);
+
+extern "C"
+{
+	/**
+	 * Copies the given rule package data into memory owned by the encoder library.
+	 *
+	 * @param data rule package (zip) data
+	 * @param size size of the data in bytes
+	 * @return the id of the registered rule package. Use it to build the URI "<RULE_PACKAGE_URI_SCHEME>:/<id>.rpk".
+	 */
+	CODEC_EXPORTS_API uint64_t registerRulePackage(const uint8_t* data, size_t size);
+
+	/**
+	 * Releases the data of a registered rule package. Streams which are still open keep their data alive until they are destroyed.
+	 *
+	 * @param id the id returned by registerRulePackage
+	 */
+	CODEC_EXPORTS_API void unregisterRulePackage(uint64_t id);
+}
@@ -0,0 +1,285 @@
+/* Copyright 2021 Esri
+ *
+ * Licensed under the Apache License Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "GenerateResultCache.h"
+
+#include "VitruvioModule.h"
+
+#include <algorithm>
+#include <cwchar>
+#include <vector>
+
+namespace
+{
+constexpr int64 DEFAULT_MEMORY_BUDGET = 256 * 1024 * 1024;
+
+template <typename T>
+void UpdateHash(FMD5& Md5, const T& Value)
+{
+	Md5.Update(reinterpret_cast<const uint8*>(&Value), sizeof(T));
+}
+
+void UpdateHash(FMD5& Md5, const wchar_t* String)
+{
+	const uint64 Length = String ? std::wcslen(String) : 0;
+	UpdateHash(Md5, Length);
+	Md5.Update(reinterpret_cast<const uint8*>(String), Length * sizeof(wchar_t));
+}
+
+void UpdateHash(FMD5& Md5, const prt::AttributeMap* Attributes)
+{
+	if (!Attributes)
+	{
+		return;
+	}
+
+	size_t KeyCount = 0;
+	const wchar_t* const* Keys = Attributes->getKeys(&KeyCount);
+
+	// Attribute maps do not guarantee any key order
+	std::vector<const wchar_t*> SortedKeys(Keys, Keys + KeyCount);
+	std::sort(SortedKeys.begin(), SortedKeys.end(), [](const wchar_t* A, const wchar_t* B) { return std::wcscmp(A, B) < 0; });
+
+	for (const wchar_t* Key : SortedKeys)
+	{
+		const prt::Attributable::PrimitiveType Type = Attributes->getType(Key);
+		UpdateHash(Md5, Key);
+		UpdateHash(Md5, Type);
+
+		size_t Count = 0;
+		switch (Type)
+		{
+		case prt::Attributable::PT_BOOL:
+			UpdateHash(Md5, Attributes->getBool(Key));
+			break;
+		case prt::Attributable::PT_INT:
+			UpdateHash(Md5, Attributes->getInt(Key));
+			break;
+		case prt::Attributable::PT_FLOAT:
+			UpdateHash(Md5, Attributes->getFloat(Key));
+			break;
+		case prt::Attributable::PT_STRING:
+			UpdateHash(Md5, Attributes->getString(Key));
+			break;
+		case prt::Attributable::PT_BOOL_ARRAY:
+		{
+			const bool* Values = Attributes->getBoolArray(Key, &Count);
+			Md5.Update(reinterpret_cast<const uint8*>(Values), Count * sizeof(bool));
+			break;
+		}
+		case prt::Attributable::PT_INT_ARRAY:
+		{
+			const int32_t* Values = Attributes->getIntArray(Key, &Count);
+			Md5.Update(reinterpret_cast<const uint8*>(Values), Count * sizeof(int32_t));
+			break;
+		}
+		case prt::Attributable::PT_FLOAT_ARRAY:
+		{
+			const double* Values = Attributes->getFloatArray(Key, &Count);
+			Md5.Update(reinterpret_cast<const uint8*>(Values), Count * sizeof(double));
+			break;
+		}
+		case prt::Attributable::PT_STRING_ARRAY:
+		{
+			const wchar_t* const* Values = Attributes->getStringArray(Key, &Count);
+			for (size_t ValueIndex = 0; ValueIndex < Count; ++ValueIndex)
+			{
+				UpdateHash(Md5, Values[ValueIndex]);
+			}
+			break;
+		}
+		default:
+			break;
+		}
+		UpdateHash(Md5, static_cast<uint64>(Count));
+	}
+}
+
+int64 EstimateMemorySize(const FMeshDescription& MeshDescription)
+{
+	// Rough per element estimate of the connectivity and attribute data
+	return MeshDescription.Vertices().Num() * 32 + MeshDescription.VertexInstances().Num() * 64 + MeshDescription.Edges().Num() * 16 +
+		   MeshDescription.Triangles().Num() * 32 + MeshDescription.Polygons().Num() * 32;
+}
+
+int64 EstimateMemorySize(const FGenerateResultDescription& Result)
+{
+	int64 Size = sizeof(FGenerateResultDescription);
+	for (const auto& IdAndMesh : Result.Meshes)
+	{
+		if (IdAndMesh.Value)
+		{
+			Size += EstimateMemorySize(IdAndMesh.Value->GetMeshDescription());
+		}
+	}
+	for (const auto& Instance : Result.Instances)
+	{
+		Size += Instance.Value.Num() * sizeof(FTransform);
+	}
+	for (const auto& IdAndName : Result.Names)
+	{
+		Size += IdAndName.Value.GetAllocatedSize();
+	}
+	Size += Result.Reports.BoolReports.GetAllocatedSize() + Result.Reports.FloatReports.GetAllocatedSize() +
+			Result.Reports.StringReports.GetAllocatedSize();
+	for (const auto& KeyAndValue : Result.Reports.StringReports)
+	{
+		Size += KeyAndValue.Value.GetAllocatedSize();
+	}
+	return Size;
+}
+
+} // namespace
+
+FGenerateResultCache::FGenerateResultCache() : MemoryBudget(DEFAULT_MEMORY_BUDGET) {}
+
+FGenerateResultCache::~FGenerateResultCache() = default;
+
+FGenerateResultCache::FKey FGenerateResultCache::ComputeKey(URulePackage* RulePackage, const TArray<FInitialShapeFace>& InitialShape,
+															const prt::AttributeMap* Attributes, int32 RandomSeed)
+{
+	const FMD5Hash RulePackageHash = GetRulePackageHash(RulePackage);
+
+	FMD5 Md5;
+	Md5.Update(RulePackageHash.GetBytes(), RulePackageHash.GetSize());
+
+	UpdateHash(Md5, InitialShape.Num());
+	for (const FInitialShapeFace& Face : InitialShape)
+	{
+		UpdateHash(Md5, Face.Vertices.Num());
+		Md5.Update(reinterpret_cast<const uint8*>(Face.Vertices.GetData()), Face.Vertices.Num() * sizeof(FVector));
+	}
+
+	UpdateHash(Md5, Attributes);
+	UpdateHash(Md5, RandomSeed);
+
+	FKey Key;
+	Key.Set(Md5);
+	return Key;
+}
+
+FMD5Hash FGenerateResultCache::GetRulePackageHash(URulePackage* RulePackage)
+{
+	check(RulePackage);
+
+	const TLazyObjectPtr<URulePackage> LazyRulePackagePtr(RulePackage);
+
+	FScopeLock Lock(&CacheLock);
+	const FMD5Hash* CachedRulePackageHash = RulePackageHashes.Find(LazyRulePackagePtr);
+	if (CachedRulePackageHash)
+	{
+		return *CachedRulePackageHash;
+	}
+
+	FMD5 RulePackageMd5;
+	RulePackageMd5.Update(RulePackage->Data.GetData(), RulePackage->Data.Num());
+	FMD5Hash RulePackageHash;
+	RulePackageHash.Set(RulePackageMd5);
+	RulePackageHashes.Add(LazyRulePackagePtr, RulePackageHash);
+	return RulePackageHash;
+}
+
+FGenerateResultCache::FValuePtr FGenerateResultCache::Find(const FKey& Key)
+{
+	FScopeLock Lock(&CacheLock);
+	FEntry* Entry = Cache.Find(Key);
+	if (!Entry)
+	{
+		Misses.Increment();
+		INC_DWORD_STAT(STAT_VitruvioGenerateResultCacheMisses);
+		return {};
+	}
+
+	// Move to the front of the LRU list
+	LruList.RemoveNode(Entry->LruNode, false);
+	LruList.AddHead(Entry->LruNode);
+
+	Hits.Increment();
+	INC_DWORD_STAT(STAT_VitruvioGenerateResultCacheHits);
+	return Entry->Result;
+}
+
+void FGenerateResultCache::Add(const FKey& Key, const FValuePtr& Result)
+{
+	check(Result);
+
+	const int64 Size = EstimateMemorySize(*Result);
+
+	FScopeLock Lock(&CacheLock);
+
+	if (Size > MemoryBudget)
+	{
+		return;
+	}
+
+	FEntry* ExistingEntry = Cache.Find(Key);
+	if (ExistingEntry)
+	{
+		MemoryUsage -= ExistingEntry->Size;
+		LruList.RemoveNode(ExistingEntry->LruNode);
+		Cache.Remove(Key);
+	}
+
+	LruList.AddHead(Key);
+	Cache.Add(Key, {Result, Size, LruList.GetHead()});
+	MemoryUsage += Size;
+
+	while (MemoryUsage > MemoryBudget)
+	{
+		EvictLeastRecentlyUsed();
+	}
+
+	SET_MEMORY_STAT(STAT_VitruvioGenerateResultCacheMemory, MemoryUsage);
+}
+
+void FGenerateResultCache::EvictRulePackage(URulePackage* RulePackage)
+{
+	FScopeLock Lock(&CacheLock);
+	RulePackageHashes.Remove(TLazyObjectPtr<URulePackage>(RulePackage));
+}
+
+void FGenerateResultCache::Empty()
+{
+	FScopeLock Lock(&CacheLock);
+	Cache.Empty();
+	LruList.Empty();
+	MemoryUsage = 0;
+
+	SET_MEMORY_STAT(STAT_VitruvioGenerateResultCacheMemory, MemoryUsage);
+}
+
+void FGenerateResultCache::SetMemoryBudget(int64 InMemoryBudget)
+{
+	FScopeLock Lock(&CacheLock);
+	MemoryBudget = InMemoryBudget;
+
+	while (MemoryUsage > MemoryBudget)
+	{
+		EvictLeastRecentlyUsed();
+	}
+
+	SET_MEMORY_STAT(STAT_VitruvioGenerateResultCacheMemory, MemoryUsage);
+}
+
+void FGenerateResultCache::EvictLeastRecentlyUsed()
+{
+	TDoubleLinkedList<FKey>::TDoubleLinkedListNode* LeastRecentlyUsed = LruList.GetTail();
+	check(LeastRecentlyUsed);
+
+	const FKey Key = LeastRecentlyUsed->GetValue();
+	MemoryUsage -= Cache[Key].Size;
+	Cache.Remove(Key);
+	LruList.RemoveNode(LeastRecentlyUsed);
+}
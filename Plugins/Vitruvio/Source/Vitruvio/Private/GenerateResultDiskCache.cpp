@@ -0,0 +1,526 @@
+/* Copyright 2021 Esri
+ *
+ * Licensed under the Apache License Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "GenerateResultDiskCache.h"
+
+#include "VitruvioModule.h"
+
+#include "Async/Async.h"
+#include "Async/MappedFileHandle.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformFilemanager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/CustomVersion.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+namespace
+{
+constexpr uint32 CACHE_ENTRY_MAGIC = 0x43525656; // "VVRC"
+constexpr int32 CACHE_FORMAT_VERSION = 5;
+
+// Pruning deletes entries until the cache is reduced to this fraction of its maximum size so that it does not run on every write
+constexpr double PRUNE_TARGET_FRACTION = 0.75;
+
+// Every entry of the attribute map is stored as key, type and value
+void SaveAttributeMap(FArchive& Ar, const prt::AttributeMap& AttributeMap)
+{
+	size_t KeyCount = 0;
+	const wchar_t* const* Keys = AttributeMap.getKeys(&KeyCount);
+	int32 NumKeys = static_cast<int32>(KeyCount);
+	Ar << NumKeys;
+
+	for (size_t KeyIndex = 0; KeyIndex < KeyCount; ++KeyIndex)
+	{
+		const wchar_t* Key = Keys[KeyIndex];
+		const prt::AttributeMap::PrimitiveType Type = AttributeMap.getType(Key);
+		FString KeyString(Key);
+		uint8 TypeValue = static_cast<uint8>(Type);
+		Ar << KeyString;
+		Ar << TypeValue;
+
+		size_t Count = 0;
+		switch (Type)
+		{
+		case prt::AttributeMap::PT_BOOL:
+		{
+			bool Value = AttributeMap.getBool(Key);
+			Ar << Value;
+			break;
+		}
+		case prt::AttributeMap::PT_INT:
+		{
+			int32 Value = AttributeMap.getInt(Key);
+			Ar << Value;
+			break;
+		}
+		case prt::AttributeMap::PT_FLOAT:
+		{
+			double Value = AttributeMap.getFloat(Key);
+			Ar << Value;
+			break;
+		}
+		case prt::AttributeMap::PT_STRING:
+		{
+			FString Value(AttributeMap.getString(Key));
+			Ar << Value;
+			break;
+		}
+		case prt::AttributeMap::PT_BOOL_ARRAY:
+		{
+			const bool* Values = AttributeMap.getBoolArray(Key, &Count);
+			TArray<bool> Array(Values, static_cast<int32>(Count));
+			Ar << Array;
+			break;
+		}
+		case prt::AttributeMap::PT_INT_ARRAY:
+		{
+			const int32_t* Values = AttributeMap.getIntArray(Key, &Count);
+			TArray<int32> Array(Values, static_cast<int32>(Count));
+			Ar << Array;
+			break;
+		}
+		case prt::AttributeMap::PT_FLOAT_ARRAY:
+		{
+			const double* Values = AttributeMap.getFloatArray(Key, &Count);
+			TArray<double> Array(Values, static_cast<int32>(Count));
+			Ar << Array;
+			break;
+		}
+		case prt::AttributeMap::PT_STRING_ARRAY:
+		{
+			const wchar_t* const* Values = AttributeMap.getStringArray(Key, &Count);
+			TArray<FString> Array;
+			Array.Reserve(static_cast<int32>(Count));
+			for (size_t ValueIndex = 0; ValueIndex < Count; ++ValueIndex)
+			{
+				Array.Add(FString(Values[ValueIndex]));
+			}
+			Ar << Array;
+			break;
+		}
+		default:
+			// Blind data is not emitted by the attribute evaluation, only the key and type are stored
+			break;
+		}
+	}
+}
+
+AttributeMapUPtr LoadAttributeMap(FArchive& Ar)
+{
+	int32 NumKeys = 0;
+	Ar << NumKeys;
+
+	const AttributeMapBuilderUPtr Builder(prt::AttributeMapBuilder::create());
+	for (int32 KeyIndex = 0; KeyIndex < NumKeys && !Ar.IsError(); ++KeyIndex)
+	{
+		FString Key;
+		uint8 TypeValue = prt::AttributeMap::PT_UNDEFINED;
+		Ar << Key;
+		Ar << TypeValue;
+
+		switch (static_cast<prt::AttributeMap::PrimitiveType>(TypeValue))
+		{
+		case prt::AttributeMap::PT_BOOL:
+		{
+			bool Value;
+			Ar << Value;
+			Builder->setBool(TCHAR_TO_WCHAR(*Key), Value);
+			break;
+		}
+		case prt::AttributeMap::PT_INT:
+		{
+			int32 Value;
+			Ar << Value;
+			Builder->setInt(TCHAR_TO_WCHAR(*Key), Value);
+			break;
+		}
+		case prt::AttributeMap::PT_FLOAT:
+		{
+			double Value;
+			Ar << Value;
+			Builder->setFloat(TCHAR_TO_WCHAR(*Key), Value);
+			break;
+		}
+		case prt::AttributeMap::PT_STRING:
+		{
+			FString Value;
+			Ar << Value;
+			Builder->setString(TCHAR_TO_WCHAR(*Key), TCHAR_TO_WCHAR(*Value));
+			break;
+		}
+		case prt::AttributeMap::PT_BOOL_ARRAY:
+		{
+			TArray<bool> Array;
+			Ar << Array;
+			Builder->setBoolArray(TCHAR_TO_WCHAR(*Key), Array.GetData(), Array.Num());
+			break;
+		}
+		case prt::AttributeMap::PT_INT_ARRAY:
+		{
+			TArray<int32> Array;
+			Ar << Array;
+			Builder->setIntArray(TCHAR_TO_WCHAR(*Key), Array.GetData(), Array.Num());
+			break;
+		}
+		case prt::AttributeMap::PT_FLOAT_ARRAY:
+		{
+			TArray<double> Array;
+			Ar << Array;
+			Builder->setFloatArray(TCHAR_TO_WCHAR(*Key), Array.GetData(), Array.Num());
+			break;
+		}
+		case prt::AttributeMap::PT_STRING_ARRAY:
+		{
+			TArray<FString> Array;
+			Ar << Array;
+			std::vector<const wchar_t*> Values;
+			Values.reserve(Array.Num());
+			for (const FString& Value : Array)
+			{
+				Values.push_back(*Value);
+			}
+			Builder->setStringArray(TCHAR_TO_WCHAR(*Key), Values.data(), Values.size());
+			break;
+		}
+		default:
+			break;
+		}
+	}
+
+	return AttributeMapUPtr(Builder->createAttributeMap());
+}
+
+void SerializeResult(FArchive& Ar, FGenerateResultDescription& Result, const RuleFileInfoPtr& RuleFileInfo)
+{
+	int32 NumMeshes = Result.Meshes.Num();
+	Ar << NumMeshes;
+
+	if (Ar.IsLoading())
+	{
+		for (int32 MeshIndex = 0; MeshIndex < NumMeshes && !Ar.IsError(); ++MeshIndex)
+		{
+			int32 PrototypeId;
+			FString Uri;
+			FMeshDescription MeshDescription;
+			TArray<Vitruvio::FMaterialAttributeContainer> Materials;
+			FVitruvioMeshStats Stats;
+			uint64 ContentHash;
+
+			Ar << PrototypeId;
+			Ar << Uri;
+			Ar << MeshDescription;
+			Ar << Materials;
+			Ar << Stats;
+			Ar << ContentHash;
+
+			TSharedPtr<FVitruvioMesh> Mesh = MakeShared<FVitruvioMesh>(Uri, MeshDescription, Materials, Stats);
+			Mesh->SetContentHash(ContentHash);
+
+			// Meshes are shared with meshes from other generate results (see UnrealCallbacks::addMesh)
+			if (!Uri.IsEmpty())
+			{
+				Mesh = VitruvioModule::Get().GetMeshCache().InsertOrGet(Uri, Mesh);
+			}
+			else if (ContentHash != 0)
+			{
+				Mesh = VitruvioModule::Get().GetMeshCache().InsertOrGetByContent(Mesh);
+			}
+
+			Result.Meshes.Add(PrototypeId, Mesh);
+		}
+	}
+	else
+	{
+		for (auto& IdAndMesh : Result.Meshes)
+		{
+			int32 PrototypeId = IdAndMesh.Key;
+			FString Uri = IdAndMesh.Value->GetUri();
+			uint64 ContentHash = IdAndMesh.Value->GetContentHash();
+
+			Ar << PrototypeId;
+			Ar << Uri;
+			// Saving does not modify the serialized objects
+			Ar << const_cast<FMeshDescription&>(IdAndMesh.Value->GetMeshDescription());
+			Ar << const_cast<TArray<Vitruvio::FMaterialAttributeContainer>&>(IdAndMesh.Value->GetMaterials());
+			Ar << const_cast<FVitruvioMeshStats&>(IdAndMesh.Value->GetStats());
+			Ar << ContentHash;
+		}
+	}
+
+	Ar << Result.Instances;
+	Ar << Result.Names;
+	Ar << Result.Reports;
+
+	// The evaluated attributes let requests which evaluate the rule attributes (eg. when a map is loaded) be served from the cache as well
+	bool bHasEvaluatedAttributes = Result.EvaluatedAttributes && Result.EvaluatedAttributes->GetAttributeMap();
+	Ar << bHasEvaluatedAttributes;
+	if (bHasEvaluatedAttributes)
+	{
+		if (Ar.IsLoading())
+		{
+			AttributeMapUPtr EvaluatedAttributes = LoadAttributeMap(Ar);
+
+			// Attributes can only be converted with the rule file info of the loaded rule package
+			if (RuleFileInfo && !Ar.IsError())
+			{
+				Result.EvaluatedAttributes = MakeShared<FAttributeMap>(std::move(EvaluatedAttributes), RuleFileInfo);
+			}
+		}
+		else
+		{
+			SaveAttributeMap(Ar, *Result.EvaluatedAttributes->GetAttributeMap());
+		}
+	}
+}
+
+} // namespace
+
+void FGenerateResultDiskCache::Initialize(const FString& InCacheDirectory, const FString& InVersion, int64 InMaxSize)
+{
+	Version = InVersion;
+	MaxSize = InMaxSize;
+
+	// Entries of different versions are stored in different folders
+	const FString VersionHash = FMD5::HashAnsiString(*FString::Printf(TEXT("%s_%d"), *Version, CACHE_FORMAT_VERSION));
+	CacheDirectory = FPaths::Combine(InCacheDirectory, VersionHash);
+
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	PlatformFile.CreateDirectoryTree(*CacheDirectory);
+
+	// Entries of other versions can never be loaded again
+	TArray<FString> VersionDirectories;
+	PlatformFile.IterateDirectory(*InCacheDirectory, [&VersionDirectories](const TCHAR* Path, bool bIsDirectory) {
+		if (bIsDirectory)
+		{
+			VersionDirectories.Add(Path);
+		}
+		return true;
+	});
+	for (const FString& VersionDirectory : VersionDirectories)
+	{
+		if (FPaths::GetCleanFilename(VersionDirectory) != VersionHash)
+		{
+			PlatformFile.DeleteDirectoryRecursively(*VersionDirectory);
+		}
+	}
+
+	if (MaxSize > 0)
+	{
+		PendingWrites.Increment();
+		Async(EAsyncExecution::ThreadPool, [this]() {
+			Prune();
+			PendingWrites.Decrement();
+		});
+	}
+}
+
+FGenerateResultCache::FValuePtr FGenerateResultDiskCache::Load(const FGenerateResultCache::FKey& Key, const RuleFileInfoPtr& RuleFileInfo) const
+{
+	if (!IsEnabled())
+	{
+		return {};
+	}
+
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	const FString EntryPath = GetEntryPath(Key);
+
+	if (!PlatformFile.FileExists(*EntryPath))
+	{
+		INC_DWORD_STAT(STAT_VitruvioGenerateResultDiskCacheMisses);
+		return {};
+	}
+
+	FGenerateResultCache::FValuePtr Result;
+
+	// Prefer memory mapped reads and fall back to reading the whole file on platforms which do not support it
+	TUniquePtr<IMappedFileHandle> MappedFile(PlatformFile.OpenMapped(*EntryPath));
+	TUniquePtr<IMappedFileRegion> MappedRegion(MappedFile ? MappedFile->MapRegion(0, MappedFile->GetFileSize()) : nullptr);
+	if (MappedRegion)
+	{
+		Result = Deserialize(MakeArrayView(MappedRegion->GetMappedPtr(), MappedRegion->GetMappedSize()), RuleFileInfo);
+	}
+	else
+	{
+		TArray<uint8> Data;
+		if (FFileHelper::LoadFileToArray(Data, *EntryPath, FILEREAD_Silent))
+		{
+			Result = Deserialize(Data, RuleFileInfo);
+		}
+	}
+
+	// Release the mapped region before the file handle
+	MappedRegion.Reset();
+	MappedFile.Reset();
+
+	if (!Result)
+	{
+		UE_LOG(LogUnrealPrt, Warning, TEXT("Ignoring invalid generate cache entry %s"), *EntryPath)
+		INC_DWORD_STAT(STAT_VitruvioGenerateResultDiskCacheMisses);
+		return {};
+	}
+
+	// The modification time is used as last access time for pruning since access times are not updated on all file systems
+	PlatformFile.SetTimeStamp(*EntryPath, FDateTime::UtcNow());
+
+	INC_DWORD_STAT(STAT_VitruvioGenerateResultDiskCacheHits);
+	return Result;
+}
+
+FGenerateResultCache::FValuePtr FGenerateResultDiskCache::Deserialize(TArrayView<const uint8> Data, const RuleFileInfoPtr& RuleFileInfo) const
+{
+	FMemoryReaderView Reader(Data);
+
+	uint32 Magic = 0;
+	FString EntryVersion;
+	Reader << Magic;
+	Reader << EntryVersion;
+
+	if (Reader.IsError() || Magic != CACHE_ENTRY_MAGIC || EntryVersion != Version)
+	{
+		return {};
+	}
+
+	// Restore the custom versions (eg. of the mesh description) which have been used while writing the entry
+	FCustomVersionContainer CustomVersions;
+	CustomVersions.Serialize(Reader);
+	Reader.SetCustomVersions(CustomVersions);
+
+	TSharedPtr<FGenerateResultDescription, ESPMode::ThreadSafe> Result = MakeShared<FGenerateResultDescription, ESPMode::ThreadSafe>();
+	SerializeResult(Reader, *Result, RuleFileInfo);
+
+	if (Reader.IsError())
+	{
+		return {};
+	}
+
+	return Result;
+}
+
+void FGenerateResultDiskCache::Store(const FGenerateResultCache::FKey& Key, const FGenerateResultDescription& Result) const
+{
+	if (!IsEnabled())
+	{
+		return;
+	}
+
+	TArray<uint8> Body;
+	FMemoryWriter BodyWriter(Body);
+	SerializeResult(BodyWriter, const_cast<FGenerateResultDescription&>(Result), {});
+
+	TArray<uint8> Entry;
+	FMemoryWriter EntryWriter(Entry);
+
+	uint32 Magic = CACHE_ENTRY_MAGIC;
+	FString EntryVersion = Version;
+	EntryWriter << Magic;
+	EntryWriter << EntryVersion;
+
+	FCustomVersionContainer CustomVersions = BodyWriter.GetCustomVersions();
+	CustomVersions.Serialize(EntryWriter);
+
+	EntryWriter.Serialize(Body.GetData(), Body.Num());
+
+	// The result is serialized right away since its meshes are modified once they are built, only the file is written in the background
+	PendingWrites.Increment();
+	Async(EAsyncExecution::ThreadPool, [this, EntryPath = GetEntryPath(Key), Entry = MoveTemp(Entry)]() {
+		// Write to a temporary file first so that concurrent readers never see partially written entries
+		const FString TempEntryPath = FPaths::CreateTempFilename(*CacheDirectory, TEXT("Entry_"), TEXT(".tmp"));
+		if (FFileHelper::SaveArrayToFile(Entry, *TempEntryPath) && IFileManager::Get().Move(*EntryPath, *TempEntryPath, true))
+		{
+			const int64 NewSize = Size += Entry.Num();
+			if (MaxSize > 0 && NewSize > MaxSize)
+			{
+				Prune();
+			}
+		}
+		PendingWrites.Decrement();
+	});
+}
+
+void FGenerateResultDiskCache::Flush() const
+{
+	FGenericPlatformProcess::ConditionalSleep([this]() { return PendingWrites.GetValue() == 0; }, 0);
+}
+
+void FGenerateResultDiskCache::Prune() const
+{
+	FScopeLock Lock(&PruneLock);
+
+	struct FEntry
+	{
+		FString Path;
+		FDateTime LastUsed;
+		int64 Size;
+	};
+
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+
+	TArray<FEntry> Entries;
+	int64 TotalSize = 0;
+	PlatformFile.IterateDirectoryStat(*CacheDirectory, [&Entries, &TotalSize](const TCHAR* Path, const FFileStatData& StatData) {
+		if (!StatData.bIsDirectory && FPaths::GetExtension(Path) == TEXT("vgr"))
+		{
+			Entries.Add({Path, StatData.ModificationTime, StatData.FileSize});
+			TotalSize += StatData.FileSize;
+		}
+		return true;
+	});
+
+	if (MaxSize > 0 && TotalSize > MaxSize)
+	{
+		Entries.Sort([](const FEntry& A, const FEntry& B) { return A.LastUsed < B.LastUsed; });
+
+		const int64 TargetSize = static_cast<int64>(MaxSize * PRUNE_TARGET_FRACTION);
+		int32 NumDeleted = 0;
+		for (const FEntry& Entry : Entries)
+		{
+			if (TotalSize <= TargetSize)
+			{
+				break;
+			}
+			if (PlatformFile.DeleteFile(*Entry.Path))
+			{
+				TotalSize -= Entry.Size;
+				++NumDeleted;
+			}
+		}
+
+		UE_LOG(LogUnrealPrt, Log, TEXT("Deleted %d least recently used generate cache entries"), NumDeleted)
+	}
+
+	Size = TotalSize;
+}
+
+void FGenerateResultDiskCache::Clear() const
+{
+	if (!IsEnabled())
+	{
+		return;
+	}
+
+	Flush();
+
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	PlatformFile.DeleteDirectoryRecursively(*CacheDirectory);
+	PlatformFile.CreateDirectoryTree(*CacheDirectory);
+	Size = 0;
+}
+
+FString FGenerateResultDiskCache::GetEntryPath(const FGenerateResultCache::FKey& Key) const
+{
+	return FPaths::Combine(CacheDirectory, LexToString(Key) + TEXT(".vgr"));
+}
@@ -0,0 +1,74 @@
+/* Copyright 2021 Esri
+ *
+ * Licensed under the Apache License Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "GeneratedModelCollision.h"
+#include "VitruvioModule.h"
+
+#include "Engine/CollisionProfile.h"
+#include "PhysicsEngine/BodySetup.h"
+
+bool UGeneratedModelCollision::GetPhysicsTriMeshData(FTriMeshCollisionData* TriCollisionData, bool InUseAllTriData)
+{
+	if (!ContainsPhysicsTriMeshData(InUseAllTriData))
+	{
+		return false;
+	}
+
+	TriCollisionData->Indices = CollisionData->Indices;
+	TriCollisionData->Vertices = CollisionData->Vertices;
+	TriCollisionData->bFlipNormals = true;
+	return true;
+}
+
+UBodySetup* UGeneratedModelCollision::GetBodySetup(bool bComplexCollision)
+{
+	check(IsInGameThread());
+
+	UBodySetup*& BodySetup = bComplexCollision ? ComplexBodySetup : SimpleBodySetup;
+	const bool bCooked = bComplexCollision ? bComplexBodySetupCooked : bSimpleBodySetupCooked;
+	if (!BodySetup)
+	{
+		// The body setup gets its collision data from its outer (see GetPhysicsTriMeshData)
+		BodySetup = NewObject<UBodySetup>(this, NAME_None, RF_Transient | RF_DuplicateTransient | RF_TextExportTransient);
+		BodySetup->DefaultInstance.SetCollisionProfileName(UCollisionProfile::BlockAll_ProfileName);
+		BodySetup->CollisionTraceFlag =
+			bComplexCollision ? ECollisionTraceFlag::CTF_UseComplexAsSimple : ECollisionTraceFlag::CTF_UseSimpleAsComplex;
+		BodySetup->bDoubleSidedGeometry = true;
+		BodySetup->bMeshCollideAll = true;
+		BodySetup->InvalidatePhysicsData();
+		BodySetup->CreatePhysicsMeshesAsync(
+			FOnAsyncPhysicsCookFinished::CreateUObject(this, &UGeneratedModelCollision::FinishPhysicsAsyncCook, bComplexCollision));
+	}
+
+	return bCooked ? BodySetup : nullptr;
+}
+
+void UGeneratedModelCollision::FinishPhysicsAsyncCook(bool bSuccess, bool bComplexCollision)
+{
+	// A failed cook leaves the body setup without physics meshes, it is used anyway so that the components do not wait forever
+	if (!bSuccess)
+	{
+		UE_LOG(LogUnrealPrt, Warning, TEXT("Could not cook the collision of %s"), *GetNameSafe(GetOuter()));
+	}
+
+	if (bComplexCollision)
+	{
+		bComplexBodySetupCooked = true;
+	}
+	else
+	{
+		bSimpleBodySetupCooked = true;
+	}
+}
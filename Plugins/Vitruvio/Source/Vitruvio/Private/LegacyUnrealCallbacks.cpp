@@ -0,0 +1,123 @@
+/* Copyright 2021 Esri
+ *
+ * Licensed under the Apache License Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "LegacyUnrealCallbacks.h"
+
+namespace
+{
+
+// Version 1 encoders encode a single initial shape per generate call
+constexpr size_t LEGACY_INITIAL_SHAPE_INDEX = 0;
+
+// Version 1 encoders do not pass any statistics, so they are computed from the geometry in PRT space
+UnrealMeshStats ComputeMeshStats(const double* Vtx, size_t VtxSize, const uint32_t* FaceVertexCounts, size_t FaceVertexCountsSize,
+								 size_t FaceRangesSize)
+{
+	UnrealMeshStats Stats;
+	Stats.numVertices = VtxSize / 3;
+	Stats.numMaterials = FaceRangesSize;
+	Stats.sharedIndices = false;
+
+	for (size_t FaceIndex = 0; FaceIndex < FaceVertexCountsSize; ++FaceIndex)
+	{
+		Stats.numTriangles += FaceVertexCounts[FaceIndex] >= 3 ? FaceVertexCounts[FaceIndex] - 2 : 0;
+	}
+
+	if (Stats.numVertices == 0)
+	{
+		return Stats;
+	}
+
+	for (int32 Axis = 0; Axis < 3; ++Axis)
+	{
+		Stats.boundsMin[Axis] = Vtx[Axis];
+		Stats.boundsMax[Axis] = Vtx[Axis];
+	}
+	for (size_t VertexIndex = 0; VertexIndex + 2 < VtxSize; VertexIndex += 3)
+	{
+		for (int32 Axis = 0; Axis < 3; ++Axis)
+		{
+			Stats.boundsMin[Axis] = FMath::Min(Stats.boundsMin[Axis], Vtx[VertexIndex + Axis]);
+			Stats.boundsMax[Axis] = FMath::Max(Stats.boundsMax[Axis], Vtx[VertexIndex + Axis]);
+		}
+	}
+
+	double Center[3];
+	for (int32 Axis = 0; Axis < 3; ++Axis)
+	{
+		Center[Axis] = (Stats.boundsMin[Axis] + Stats.boundsMax[Axis]) * 0.5;
+	}
+	double RadiusSquared = 0.0;
+	for (size_t VertexIndex = 0; VertexIndex + 2 < VtxSize; VertexIndex += 3)
+	{
+		const double X = Vtx[VertexIndex] - Center[0];
+		const double Y = Vtx[VertexIndex + 1] - Center[1];
+		const double Z = Vtx[VertexIndex + 2] - Center[2];
+		RadiusSquared = FMath::Max(RadiusSquared, X * X + Y * Y + Z * Z);
+	}
+	Stats.boundsRadius = FMath::Sqrt(RadiusSquared);
+
+	return Stats;
+}
+
+} // namespace
+
+int32_t FLegacyUnrealCallbacks::AddMaterial(const prt::AttributeMap* Material)
+{
+	// The attribute maps are only valid during the call, so every material gets a new id
+	const int32_t MaterialId = NextMaterialId++;
+	Callbacks.addMaterial(LEGACY_INITIAL_SHAPE_INDEX, MaterialId, Material);
+	return MaterialId;
+}
+
+void FLegacyUnrealCallbacks::addMesh(const wchar_t* name, int32_t prototypeId, const wchar_t* uri, const double* vtx, size_t vtxSize,
+									 const double* nrm, size_t nrmSize, const uint32_t* faceVertexCounts, size_t faceVertexCountsSize,
+									 const uint32_t* vertexIndices, size_t vertexIndicesSize, const uint32_t* normalIndices, size_t normalIndicesSize,
+
+									 double const* const* uvs, size_t const* uvsSizes, uint32_t const* const* uvCounts, size_t const* uvCountsSizes,
+									 uint32_t const* const* uvIndices, size_t const* uvIndicesSizes, size_t uvSets,
+
+									 const uint32_t* faceRanges, size_t faceRangesSize, const prt::AttributeMap** materials)
+{
+	TArray<int32_t> MaterialIds;
+	MaterialIds.Reserve(static_cast<int32>(faceRangesSize));
+	for (size_t PolygonGroupIndex = 0; PolygonGroupIndex < faceRangesSize; ++PolygonGroupIndex)
+	{
+		MaterialIds.Add(AddMaterial(materials[PolygonGroupIndex]));
+	}
+
+	const UnrealMeshStats Stats = ComputeMeshStats(vtx, vtxSize, faceVertexCounts, faceVertexCountsSize, faceRangesSize);
+
+	Callbacks.addMesh(LEGACY_INITIAL_SHAPE_INDEX, name, prototypeId, uri, vtx, vtxSize, nrm, nrmSize, faceVertexCounts, faceVertexCountsSize,
+					  vertexIndices, vertexIndicesSize, normalIndices, normalIndicesSize, uvs, uvsSizes, uvCounts, uvCountsSizes, uvIndices,
+					  uvIndicesSizes, uvSets, faceRanges, faceRangesSize, MaterialIds.GetData(), Stats);
+}
+
+void FLegacyUnrealCallbacks::addInstance(int32_t prototypeId, const double* transform, const prt::AttributeMap** instanceMaterial,
+										 size_t numInstanceMaterials)
+{
+	TArray<int32_t> InstanceMaterialIds;
+	if (instanceMaterial)
+	{
+		InstanceMaterialIds.Reserve(static_cast<int32>(numInstanceMaterials));
+		for (size_t MatIndex = 0; MatIndex < numInstanceMaterials; ++MatIndex)
+		{
+			InstanceMaterialIds.Add(AddMaterial(instanceMaterial[MatIndex]));
+		}
+	}
+
+	Callbacks.addInstance(LEGACY_INITIAL_SHAPE_INDEX, prototypeId, transform, instanceMaterial ? InstanceMaterialIds.GetData() : nullptr,
+						  numInstanceMaterials);
+}
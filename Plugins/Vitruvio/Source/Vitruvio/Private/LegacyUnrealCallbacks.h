@@ -0,0 +1,154 @@
+/* Copyright 2021 Esri
+ *
+ * Licensed under the Apache License Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "UnrealCallbacks.h"
+
+#include "prt/Callbacks.h"
+
+/**
+ * Layout of IUnrealCallbacks before it was versioned (version 1). Encoder libraries which do not export getUnrealCallbacksVersion call
+ * these functions after the prt::Callbacks functions. They encode a single initial shape per generate call and pass the materials as
+ * attribute maps with every mesh and instance.
+ */
+class IUnrealCallbacksV1 : public prt::Callbacks
+{
+public:
+	~IUnrealCallbacksV1() override = default;
+
+	// clang-format off
+	virtual void addMesh(const wchar_t* name,
+	                     int32_t prototypeId, const wchar_t* uri,
+	                     const double* vtx, size_t vtxSize,
+	                     const double* nrm, size_t nrmSize,
+	                     const uint32_t* faceVertexCounts, size_t faceVertexCountsSize,
+	                     const uint32_t* vertexIndices, size_t vertexIndicesSize,
+	                     const uint32_t* normalIndices, size_t normalIndicesSize,
+
+	                     double const* const* uvs, size_t const* uvsSizes,
+	                     uint32_t const* const* uvCounts, size_t const* uvCountsSizes,
+	                     uint32_t const* const* uvIndices, size_t const* uvIndicesSizes,
+	                     size_t uvSets,
+
+	                     const uint32_t* faceRanges, size_t faceRangesSize,
+	                     const prt::AttributeMap** materials
+	) = 0;
+	// clang-format on
+
+	virtual void addInstance(int32_t prototypeId, const double* transform, const prt::AttributeMap** instanceMaterial,
+							 size_t numInstanceMaterials) = 0;
+};
+
+/**
+ * Adapts the version 1 callbacks of an outdated encoder library to UnrealCallbacks. All calls are forwarded for the first initial shape,
+ * so generate calls using this adapter must only contain a single initial shape. Materials are added to UnrealCallbacks before the meshes
+ * and instances which reference them and the mesh statistics are computed from the geometry.
+ */
+class FLegacyUnrealCallbacks final : public IUnrealCallbacksV1
+{
+	UnrealCallbacks& Callbacks;
+	int32_t NextMaterialId = 0;
+
+	int32_t AddMaterial(const prt::AttributeMap* Material);
+
+public:
+	explicit FLegacyUnrealCallbacks(UnrealCallbacks& Callbacks) : Callbacks(Callbacks)
+	{
+	}
+
+	// clang-format off
+	void addMesh(const wchar_t* name,
+		int32_t prototypeId, const wchar_t* uri,
+		const double* vtx, size_t vtxSize,
+		const double* nrm, size_t nrmSize,
+		const uint32_t* faceVertexCounts, size_t faceVertexCountsSize,
+		const uint32_t* vertexIndices, size_t vertexIndicesSize,
+		const uint32_t* normalIndices, size_t normalIndicesSize,
+
+		double const* const* uvs, size_t const* uvsSizes,
+		uint32_t const* const* uvCounts, size_t const* uvCountsSizes,
+		uint32_t const* const* uvIndices, size_t const* uvIndicesSizes,
+		size_t uvSets,
+
+		const uint32_t* faceRanges, size_t faceRangesSize,
+		const prt::AttributeMap** materials
+	) override;
+	// clang-format on
+
+	void addInstance(int32_t prototypeId, const double* transform, const prt::AttributeMap** instanceMaterial, size_t numInstanceMaterials) override;
+
+	Continuation progress(float percentageCompleted) override
+	{
+		return Callbacks.progress(percentageCompleted);
+	}
+
+	prt::Status generateError(size_t isIndex, prt::Status status, const wchar_t* message) override
+	{
+		return Callbacks.generateError(isIndex, status, message);
+	}
+	prt::Status assetError(size_t isIndex, prt::CGAErrorLevel level, const wchar_t* key, const wchar_t* uri, const wchar_t* message) override
+	{
+		return Callbacks.assetError(isIndex, level, key, uri, message);
+	}
+	prt::Status cgaError(size_t isIndex, int32_t shapeID, prt::CGAErrorLevel level, int32_t methodId, int32_t pc, const wchar_t* message) override
+	{
+		return Callbacks.cgaError(isIndex, shapeID, level, methodId, pc, message);
+	}
+	prt::Status cgaPrint(size_t isIndex, int32_t shapeID, const wchar_t* txt) override
+	{
+		return Callbacks.cgaPrint(isIndex, shapeID, txt);
+	}
+
+	prt::Status cgaReportBool(size_t isIndex, int32_t shapeID, const wchar_t* key, bool value) override
+	{
+		return Callbacks.cgaReportBool(isIndex, shapeID, key, value);
+	}
+	prt::Status cgaReportFloat(size_t isIndex, int32_t shapeID, const wchar_t* key, double value) override
+	{
+		return Callbacks.cgaReportFloat(isIndex, shapeID, key, value);
+	}
+	prt::Status cgaReportString(size_t isIndex, int32_t shapeID, const wchar_t* key, const wchar_t* value) override
+	{
+		return Callbacks.cgaReportString(isIndex, shapeID, key, value);
+	}
+
+	prt::Status attrBool(size_t isIndex, int32_t shapeID, const wchar_t* key, bool value) override
+	{
+		return Callbacks.attrBool(isIndex, shapeID, key, value);
+	}
+	prt::Status attrFloat(size_t isIndex, int32_t shapeID, const wchar_t* key, double value) override
+	{
+		return Callbacks.attrFloat(isIndex, shapeID, key, value);
+	}
+	prt::Status attrString(size_t isIndex, int32_t shapeID, const wchar_t* key, const wchar_t* value) override
+	{
+		return Callbacks.attrString(isIndex, shapeID, key, value);
+	}
+
+	prt::Status attrBoolArray(size_t isIndex, int32_t shapeID, const wchar_t* key, const bool* values, size_t size, size_t nRows) override
+	{
+		return Callbacks.attrBoolArray(isIndex, shapeID, key, values, size, nRows);
+	}
+	prt::Status attrFloatArray(size_t isIndex, int32_t shapeID, const wchar_t* key, const double* values, size_t size, size_t nRows) override
+	{
+		return Callbacks.attrFloatArray(isIndex, shapeID, key, values, size, nRows);
+	}
+	prt::Status attrStringArray(size_t isIndex, int32_t shapeID, const wchar_t* key, const wchar_t* const* values, size_t size,
+								size_t nRows) override
+	{
+		return Callbacks.attrStringArray(isIndex, shapeID, key, values, size, nRows);
+	}
+};
@@ -1,5 +1,32 @@
 #include "MeshCache.h"
 
+#include "StaticMeshAttributes.h"
+
+namespace
+{
+
+TArrayView<const FVector> GetPositions(const FVitruvioMesh& Mesh)
+{
+	const TVertexAttributesConstRef<FVector> Positions = FStaticMeshConstAttributes(Mesh.GetMeshDescription()).GetVertexPositions();
+	return TArrayView<const FVector>(Positions.GetRawArray().GetData(), Positions.GetNumElements());
+}
+
+bool HasSameContent(const FVitruvioMesh& Mesh, const TArray<Vitruvio::FMaterialAttributeContainer>& Materials, const FVitruvioMeshStats& Stats,
+					TArrayView<const FVector> Positions)
+{
+	if (Mesh.GetStats().NumVertices != Stats.NumVertices || Mesh.GetStats().NumTriangles != Stats.NumTriangles || Mesh.GetMaterials() != Materials)
+	{
+		return false;
+	}
+
+	// The vertex ids of meshes created by Vitruvio are consecutive, so the positions can be compared as a whole
+	const TArrayView<const FVector> MeshPositions = GetPositions(Mesh);
+	return MeshPositions.Num() == Positions.Num() &&
+		   FMemory::Memcmp(MeshPositions.GetData(), Positions.GetData(), Positions.Num() * sizeof(FVector)) == 0;
+}
+
+} // namespace
+
 TSharedPtr<FVitruvioMesh> FMeshCache::Get(const FString& Uri)
 {
 	FScopeLock Lock(&MeshCacheCriticalSection);
@@ -20,8 +47,53 @@ TSharedPtr<FVitruvioMesh> FMeshCache::InsertOrGet(const FString& Uri, const TSha
 	return Mesh;
 }
 
+TSharedPtr<FVitruvioMesh> FMeshCache::GetByContent(uint64 ContentHash, const TArray<Vitruvio::FMaterialAttributeContainer>& Materials,
+												   const FVitruvioMeshStats& Stats, TArrayView<const FVector> Positions)
+{
+	FScopeLock Lock(&MeshCacheCriticalSection);
+	const auto Result = ContentCache.Find(ContentHash);
+	if (!Result)
+	{
+		return {};
+	}
+
+	TSharedPtr<FVitruvioMesh> Mesh = Result->Pin();
+	return Mesh && HasSameContent(*Mesh, Materials, Stats, Positions) ? Mesh : TSharedPtr<FVitruvioMesh> {};
+}
+
+TSharedPtr<FVitruvioMesh> FMeshCache::InsertOrGetByContent(const TSharedPtr<FVitruvioMesh>& Mesh)
+{
+	FScopeLock Lock(&MeshCacheCriticalSection);
+	const auto Result = ContentCache.Find(Mesh->GetContentHash());
+	if (Result)
+	{
+		TSharedPtr<FVitruvioMesh> CachedMesh = Result->Pin();
+		if (CachedMesh)
+		{
+			return HasSameContent(*CachedMesh, Mesh->GetMaterials(), Mesh->GetStats(), GetPositions(*Mesh)) ? CachedMesh : Mesh;
+		}
+	}
+	ContentCache.Add(Mesh->GetContentHash(), Mesh);
+
+	// Remove the entries of released meshes once in a while
+	if (ContentCache.Num() > ContentCachePruneThreshold)
+	{
+		for (auto It = ContentCache.CreateIterator(); It; ++It)
+		{
+			if (!It.Value().IsValid())
+			{
+				It.RemoveCurrent();
+			}
+		}
+		ContentCachePruneThreshold = FMath::Max(1024, ContentCache.Num() * 2);
+	}
+
+	return Mesh;
+}
+
 void FMeshCache::Empty()
 {
 	FScopeLock Lock(&MeshCacheCriticalSection);
 	Cache.Empty();
+	ContentCache.Empty();
 }
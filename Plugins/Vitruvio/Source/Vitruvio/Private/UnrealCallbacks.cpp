@@ -20,6 +20,7 @@
 #include "Util/MaterialConversion.h"
 
 #include "Engine/StaticMesh.h"
+#include "Hash/CityHash.h"
 #include "IImageWrapper.h"
 #include "Materials/MaterialInstanceDynamic.h"
 #include "StaticMeshAttributes.h"
@@ -54,35 +55,336 @@ constexpr float PRT_TO_UE_SCALE = 100.0f;
 // Note that we use the same tolerance (1e-25f) as in PRT to avoid numerical issues when converting planar geometry
 constexpr float PRT_DIVISOR_LIMIT = 1e-25f;
 
+// Double precision geometry is in PRT space (meters, Y up) and has to be converted element by element
+void CreateVertices(FMeshDescription& Description, const TVertexAttributesRef<FVector>& VertexPositions, const double* Vtx, size_t VtxSize)
+{
+	Description.ReserveNewVertices(static_cast<int32>(VtxSize / 3));
+	for (size_t VertexIndex = 0; VertexIndex + 2 < VtxSize; VertexIndex += 3)
+	{
+		const FVertexID VertexID = Description.CreateVertex();
+		VertexPositions[VertexID] = FVector(Vtx[VertexIndex], Vtx[VertexIndex + 2], Vtx[VertexIndex + 1]) * PRT_TO_UE_SCALE;
+	}
+}
+
+// Creates the vertices and returns the vertex positions as a tightly packed float array which can be written to directly
+float* CreateVertices(FMeshDescription& Description, const TVertexAttributesRef<FVector>& VertexPositions, int32 NumVertices)
+{
+	static_assert(sizeof(FVector) == 3 * sizeof(float), "Vertex positions are expected to be tightly packed floats");
+
+	Description.ReserveNewVertices(NumVertices);
+	for (int32 VertexIndex = 0; VertexIndex < NumVertices; ++VertexIndex)
+	{
+		Description.CreateVertex();
+	}
+
+	// The vertex ids of a new mesh description are consecutive and start at zero
+	return reinterpret_cast<float*>(VertexPositions.GetRawArray().GetData());
+}
+
+// Single precision geometry has already been converted to Unreal space by the encoder and is copied as a whole
+void CreateVertices(FMeshDescription& Description, const TVertexAttributesRef<FVector>& VertexPositions, const float* Vtx, size_t VtxSize)
+{
+	const int32 NumVertices = static_cast<int32>(VtxSize / 3);
+	float* Positions = CreateVertices(Description, VertexPositions, NumVertices);
+	FMemory::Memcpy(Positions, Vtx, NumVertices * sizeof(FVector));
+}
+
+TArrayView<const FVector> GetVertexPositions(const FMeshDescription& Description)
+{
+	const TVertexAttributesConstRef<FVector> VertexPositions = FStaticMeshConstAttributes(Description).GetVertexPositions();
+	return TArrayView<const FVector>(VertexPositions.GetRawArray().GetData(), VertexPositions.GetNumElements());
+}
+
+template <typename T>
+FMeshDescription CreateMeshDescription(const T* Vtx, size_t VtxSize)
+{
+	FMeshDescription Description;
+	FStaticMeshAttributes Attributes(Description);
+	Attributes.Register();
+
+	CreateVertices(Description, Attributes.GetVertexPositions(), Vtx, VtxSize);
+	return Description;
+}
+
+bool IsTriangulated(const uint32_t* FaceVertexCounts, size_t FaceVertexCountsSize)
+{
+	for (size_t FaceIndex = 0; FaceIndex < FaceVertexCountsSize; ++FaceIndex)
+	{
+		if (FaceVertexCounts[FaceIndex] != 3)
+		{
+			return false;
+		}
+	}
+	return FaceVertexCountsSize > 0;
+}
+
+FVector ToUnrealNormal(const double* Nrm)
+{
+	return FVector(Nrm[0], Nrm[2], Nrm[1]);
+}
+
+FVector ToUnrealNormal(const float* Nrm)
+{
+	return FVector(Nrm[0], Nrm[1], Nrm[2]);
+}
+
+FVector2D ToUnrealUV(const double* UV)
+{
+	return FVector2D(UV[0], -UV[1]);
+}
+
+FVector2D ToUnrealUV(const float* UV)
+{
+	return FVector2D(UV[0], UV[1]);
+}
+
+template <typename T>
+uint64 HashBuffer(const T* Data, size_t Size, uint64 Hash)
+{
+	// The size is hashed as well so that the boundaries between consecutive buffers are unambiguous
+	Hash = CityHash64WithSeed(reinterpret_cast<const char*>(&Size), sizeof(Size), Hash);
+	return Data && Size > 0 ? CityHash64WithSeed(reinterpret_cast<const char*>(Data), Size * sizeof(T), Hash) : Hash;
+}
+
+// The bounds of double precision geometry are in PRT space and are converted like the vertices
+FVitruvioMeshStats ToVitruvioMeshStats(const UnrealMeshStats& Stats, bool bPrtSpace)
+{
+	const FVector Min(Stats.boundsMin[0], Stats.boundsMin[1], Stats.boundsMin[2]);
+	const FVector Max(Stats.boundsMax[0], Stats.boundsMax[1], Stats.boundsMax[2]);
+	const FBox Box =
+		bPrtSpace ? FBox(FVector(Min.X, Min.Z, Min.Y) * PRT_TO_UE_SCALE, FVector(Max.X, Max.Z, Max.Y) * PRT_TO_UE_SCALE) : FBox(Min, Max);
+	const float Radius = static_cast<float>(Stats.boundsRadius) * (bPrtSpace ? PRT_TO_UE_SCALE : 1.0f);
+
+	FVitruvioMeshStats Result;
+	Result.Bounds = FBoxSphereBounds(Box.GetCenter(), Box.GetExtent(), Radius);
+	Result.NumVertices = static_cast<int32>(Stats.numVertices);
+	Result.NumTriangles = static_cast<int32>(Stats.numTriangles);
+	Result.NumMaterials = static_cast<int32>(Stats.numMaterials);
+	return Result;
+}
+
 } // namespace
 
-void UnrealCallbacks::addMesh(const wchar_t* name, int32_t prototypeId, const wchar_t* uri, const double* vtx, size_t vtxSize, const double* nrm,
+void UnrealCallbacks::addMesh(size_t isIndex, const wchar_t* name, int32_t prototypeId, const wchar_t* uri, const double* vtx, size_t vtxSize, const double* nrm,
 							  size_t nrmSize, const uint32_t* faceVertexCounts, size_t faceVertexCountsSize, const uint32_t* vertexIndices,
 							  size_t vertexIndicesSize, const uint32_t* normalIndices, size_t normalIndicesSize,
 
 							  double const* const* uvs, size_t const* uvsSizes, uint32_t const* const* uvCounts, size_t const* uvCountsSizes,
 							  uint32_t const* const* uvIndices, size_t const* uvIndicesSizes, size_t uvSets,
 
-							  const uint32_t* faceRanges, size_t faceRangesSize, const prt::AttributeMap** materials)
+							  const uint32_t* faceRanges, size_t faceRangesSize, const int32_t* materialIds, const UnrealMeshStats& stats)
+{
+	if (AddCachedMesh(isIndex, name, prototypeId, uri))
+	{
+		return;
+	}
+
+	// The vertices are converted to Unreal space first so that they can be compared with a cached mesh
+	FMeshDescription Description = CreateMeshDescription(vtx, vtxSize);
+	const FVitruvioMeshStats Stats = ToVitruvioMeshStats(stats, true);
+
+	uint64 ContentHash;
+	if (AddContentCachedMesh(isIndex, name, prototypeId, uri, vtx, vtxSize, nrm, nrmSize, faceVertexCounts, faceVertexCountsSize, vertexIndices,
+							 vertexIndicesSize, normalIndices, normalIndicesSize, uvs, uvsSizes, uvCounts, uvCountsSizes, uvIndices, uvIndicesSizes,
+							 uvSets, faceRanges, faceRangesSize, materialIds, stats.sharedIndices, Stats, GetVertexPositions(Description), ContentHash))
+	{
+		return;
+	}
+
+	AddMesh(isIndex, name, prototypeId, uri, MoveTemp(Description), nrm, nrmSize, faceVertexCounts, faceVertexCountsSize, vertexIndices,
+			vertexIndicesSize, normalIndices, normalIndicesSize, uvs, uvsSizes, uvCounts, uvCountsSizes, uvIndices, uvIndicesSizes, uvSets, faceRanges,
+			faceRangesSize, materialIds, stats.sharedIndices, Stats, ContentHash);
+}
+
+void UnrealCallbacks::addMesh(size_t isIndex, const wchar_t* name, int32_t prototypeId, const wchar_t* uri, const float* vtx, size_t vtxSize, const float* nrm,
+							  size_t nrmSize, const uint32_t* faceVertexCounts, size_t faceVertexCountsSize, const uint32_t* vertexIndices,
+							  size_t vertexIndicesSize, const uint32_t* normalIndices, size_t normalIndicesSize,
+
+							  float const* const* uvs, size_t const* uvsSizes, uint32_t const* const* uvCounts, size_t const* uvCountsSizes,
+							  uint32_t const* const* uvIndices, size_t const* uvIndicesSizes, size_t uvSets,
+
+							  const uint32_t* faceRanges, size_t faceRangesSize, const int32_t* materialIds, const UnrealMeshStats& stats)
+{
+	check(isIndex < static_cast<size_t>(MeshBuffers.Num()));
+	FMeshBuffers& Buffers = MeshBuffers[isIndex];
+
+	const bool bAllocated = Buffers.bAllocated;
+	Buffers.bAllocated = false;
+	if (!bAllocated && AddCachedMesh(isIndex, name, prototypeId, uri))
+	{
+		return;
+	}
+
+	// The vertices are already in Unreal space and tightly packed, so they can be compared with a cached mesh as they are
+	const FVitruvioMeshStats Stats = ToVitruvioMeshStats(stats, false);
+	const TArrayView<const FVector> Positions(reinterpret_cast<const FVector*>(vtx), static_cast<int32>(vtxSize / 3));
+
+	uint64 ContentHash;
+	if (AddContentCachedMesh(isIndex, name, prototypeId, uri, vtx, vtxSize, nrm, nrmSize, faceVertexCounts, faceVertexCountsSize, vertexIndices,
+							 vertexIndicesSize, normalIndices, normalIndicesSize, uvs, uvsSizes, uvCounts, uvCountsSizes, uvIndices, uvIndicesSizes,
+							 uvSets, faceRanges, faceRangesSize, materialIds, stats.sharedIndices, Stats, Positions, ContentHash))
+	{
+		return;
+	}
+
+	// Otherwise the encoder has written the vertex positions directly into the mesh description allocated in allocateMesh
+	FMeshDescription Description = bAllocated ? MoveTemp(Buffers.Description) : CreateMeshDescription(vtx, vtxSize);
+
+	AddMesh(isIndex, name, prototypeId, uri, MoveTemp(Description), nrm, nrmSize, faceVertexCounts, faceVertexCountsSize, vertexIndices,
+			vertexIndicesSize, normalIndices, normalIndicesSize, uvs, uvsSizes, uvCounts, uvCountsSizes, uvIndices, uvIndicesSizes, uvSets, faceRanges,
+			faceRangesSize, materialIds, stats.sharedIndices, Stats, ContentHash);
+}
+
+bool UnrealCallbacks::allocateMesh(size_t isIndex, const wchar_t* name, int32_t prototypeId, const wchar_t* uri, const UnrealMeshSizes& sizes,
+								   UnrealMeshBuffers& buffers)
+{
+	if (AddCachedMesh(isIndex, name, prototypeId, uri))
+	{
+		return false;
+	}
+
+	check(isIndex < static_cast<size_t>(MeshBuffers.Num()));
+	FMeshBuffers& Buffers = MeshBuffers[isIndex];
+
+	// The vertex positions are written directly into the final mesh description
+	Buffers.Description = FMeshDescription();
+	FStaticMeshAttributes Attributes(Buffers.Description);
+	Attributes.Register();
+	buffers.vtx = CreateVertices(Buffers.Description, Attributes.GetVertexPositions(), static_cast<int32>(sizes.vtxSize / 3));
+
+	// All other streams are per vertex instance and are written into scratch arrays which keep their allocation for all meshes of this initial shape
+	Buffers.Normals.SetNumUninitialized(sizes.nrmSize, false);
+	Buffers.FaceVertexCounts.SetNumUninitialized(sizes.faceVertexCountsSize, false);
+	Buffers.VertexIndices.SetNumUninitialized(sizes.indicesSize, false);
+	Buffers.NormalIndices.SetNumUninitialized(sizes.sharedIndices ? 0 : sizes.indicesSize, false);
+	buffers.nrm = Buffers.Normals.GetData();
+	buffers.faceVertexCounts = Buffers.FaceVertexCounts.GetData();
+	buffers.vertexIndices = Buffers.VertexIndices.GetData();
+	buffers.normalIndices = sizes.sharedIndices ? nullptr : Buffers.NormalIndices.GetData();
+
+	const int32 NumUVSets = static_cast<int32>(sizes.uvSets);
+	Buffers.UVs.SetNum(FMath::Max(Buffers.UVs.Num(), NumUVSets));
+	Buffers.UVCounts.SetNum(FMath::Max(Buffers.UVCounts.Num(), NumUVSets));
+	Buffers.UVIndices.SetNum(FMath::Max(Buffers.UVIndices.Num(), NumUVSets));
+	Buffers.UVPtrs.SetNum(NumUVSets, false);
+	Buffers.UVCountPtrs.SetNum(NumUVSets, false);
+	Buffers.UVIndexPtrs.SetNum(NumUVSets, false);
+	for (int32 UVSet = 0; UVSet < NumUVSets; ++UVSet)
+	{
+		Buffers.UVs[UVSet].SetNumUninitialized(sizes.uvsSizes[UVSet], false);
+		Buffers.UVCounts[UVSet].SetNumUninitialized(sizes.uvCountsSizes[UVSet], false);
+		Buffers.UVIndices[UVSet].SetNumUninitialized(sizes.uvIndicesSizes[UVSet], false);
+		Buffers.UVPtrs[UVSet] = Buffers.UVs[UVSet].GetData();
+		Buffers.UVCountPtrs[UVSet] = Buffers.UVCounts[UVSet].GetData();
+		Buffers.UVIndexPtrs[UVSet] = Buffers.UVIndices[UVSet].GetData();
+	}
+	buffers.uvs = Buffers.UVPtrs.GetData();
+	buffers.uvCounts = Buffers.UVCountPtrs.GetData();
+	buffers.uvIndices = Buffers.UVIndexPtrs.GetData();
+
+	Buffers.bAllocated = true;
+	return true;
+}
+
+bool UnrealCallbacks::AddCachedMesh(size_t isIndex, const wchar_t* name, int32_t prototypeId, const wchar_t* uri)
 {
+	check(isIndex < static_cast<size_t>(Results.Num()));
 
 	const FString UriString(uri);
-	const FString NameString(name);
-	
-	if (!UriString.IsEmpty())
+	if (UriString.IsEmpty())
 	{
-		TSharedPtr<FVitruvioMesh> Mesh = VitruvioModule::Get().GetMeshCache().Get(UriString);
-		if (Mesh)
-		{
-			Meshes.Add(prototypeId, Mesh);
-			Names.Add(prototypeId, NameString);
-			return;
-		}
+		return false;
 	}
 
-	FMeshDescription Description;
+	TSharedPtr<FVitruvioMesh> Mesh = VitruvioModule::Get().GetMeshCache().Get(UriString);
+	if (!Mesh)
+	{
+		return false;
+	}
+
+	FInitialShapeResult& Result = Results[isIndex];
+	Result.Meshes.Add(prototypeId, Mesh);
+	Result.Names.Add(prototypeId, FString(name));
+	return true;
+}
+
+template <typename T>
+bool UnrealCallbacks::AddContentCachedMesh(size_t isIndex, const wchar_t* name, int32_t prototypeId, const wchar_t* uri, const T* vtx, size_t vtxSize,
+										   const T* nrm, size_t nrmSize, const uint32_t* faceVertexCounts, size_t faceVertexCountsSize,
+										   const uint32_t* vertexIndices, size_t vertexIndicesSize, const uint32_t* normalIndices,
+										   size_t normalIndicesSize, T const* const* uvs, size_t const* uvsSizes, uint32_t const* const* uvCounts,
+										   size_t const* uvCountsSizes, uint32_t const* const* uvIndices, size_t const* uvIndicesSizes, size_t uvSets,
+										   const uint32_t* faceRanges, size_t faceRangesSize, const int32_t* materialIds, bool bSharedIndices,
+										   const FVitruvioMeshStats& Stats, TArrayView<const FVector> Positions, uint64& OutContentHash)
+{
+	check(isIndex < static_cast<size_t>(Results.Num()));
+
+	OutContentHash = 0;
+	if (!FString(uri).IsEmpty())
+	{
+		return false;
+	}
+
+	FInitialShapeResult& Result = Results[isIndex];
+
+	TArray<Vitruvio::FMaterialAttributeContainer> MeshMaterials;
+	TArray<uint32> MaterialHashes;
+	MeshMaterials.Reserve(static_cast<int32>(faceRangesSize));
+	MaterialHashes.Reserve(static_cast<int32>(faceRangesSize));
+	for (size_t PolygonGroupIndex = 0; PolygonGroupIndex < faceRangesSize; ++PolygonGroupIndex)
+	{
+		const Vitruvio::FMaterialAttributeContainer& MaterialContainer = Result.Materials.FindChecked(materialIds[PolygonGroupIndex]);
+		MeshMaterials.Add(MaterialContainer);
+		MaterialHashes.Add(GetTypeHash(MaterialContainer));
+	}
+
+	// Identical initial shapes (eg. row houses with the same footprint, attributes and seed) produce byte identical geometry
+	uint64 Hash = HashBuffer(vtx, vtxSize, 0);
+	Hash = HashBuffer(nrm, nrmSize, Hash);
+	Hash = HashBuffer(faceVertexCounts, faceVertexCountsSize, Hash);
+	Hash = HashBuffer(vertexIndices, vertexIndicesSize, Hash);
+	Hash = HashBuffer(bSharedIndices ? nullptr : normalIndices, normalIndicesSize, Hash);
+	for (size_t UVSet = 0; UVSet < uvSets; ++UVSet)
+	{
+		Hash = HashBuffer(uvs[UVSet], uvsSizes[UVSet], Hash);
+		Hash = HashBuffer(uvCounts[UVSet], uvCountsSizes[UVSet], Hash);
+		Hash = HashBuffer(uvIndices[UVSet], uvIndicesSizes[UVSet], Hash);
+	}
+	Hash = HashBuffer(faceRanges, faceRangesSize, Hash);
+	Hash = HashBuffer(MaterialHashes.GetData(), MaterialHashes.Num(), Hash);
+
+	// 0 is reserved for meshes without content hash
+	OutContentHash = FMath::Max<uint64>(Hash, 1);
+
+	TSharedPtr<FVitruvioMesh> Mesh = VitruvioModule::Get().GetMeshCache().GetByContent(OutContentHash, MeshMaterials, Stats, Positions);
+	if (!Mesh)
+	{
+		return false;
+	}
+
+	Result.Meshes.Add(prototypeId, Mesh);
+	Result.Names.Add(prototypeId, FString(name));
+	return true;
+}
+
+template <typename T>
+void UnrealCallbacks::AddMesh(size_t isIndex, const wchar_t* name, int32_t prototypeId, const wchar_t* uri, FMeshDescription&& Description, const T* nrm,
+							  size_t nrmSize, const uint32_t* faceVertexCounts, size_t faceVertexCountsSize, const uint32_t* vertexIndices,
+							  size_t vertexIndicesSize, const uint32_t* normalIndices, size_t normalIndicesSize,
+
+							  T const* const* uvs, size_t const* uvsSizes, uint32_t const* const* uvCounts, size_t const* uvCountsSizes,
+							  uint32_t const* const* uvIndices, size_t const* uvIndicesSizes, size_t uvSets,
+
+							  const uint32_t* faceRanges, size_t faceRangesSize, const int32_t* materialIds, bool bSharedIndices,
+							  const FVitruvioMeshStats& Stats, uint64 ContentHash)
+{
+	check(isIndex < static_cast<size_t>(Results.Num()));
+	FInitialShapeResult& Result = Results[isIndex];
+
+	const FString UriString(uri);
+	const FString NameString(name);
+
 	FStaticMeshAttributes Attributes(Description);
-	Attributes.Register();
 
 	if (uvSets > 8)
 	{
@@ -94,96 +396,159 @@ void UnrealCallbacks::addMesh(const wchar_t* name, int32_t prototypeId, const wc
 	const auto VertexUVs = Attributes.GetVertexInstanceUVs();
 	VertexUVs.SetNumIndices(FMath::Max(static_cast<size_t>(1), uvSets));
 
-	// Convert vertices and vertex instances
-	const auto VertexPositions = Attributes.GetVertexPositions();
-	for (size_t VertexIndex = 0; VertexIndex < vtxSize; VertexIndex += 3)
+	// All element counts are known up front, reserve them to avoid reallocations while the mesh description is built
+	const int32 NumVertices = Description.Vertices().Num();
+	const int32 NumVertexInstances = bSharedIndices ? NumVertices : static_cast<int32>(vertexIndicesSize);
+	Description.ReserveNewVertexInstances(NumVertexInstances);
+	Description.ReserveNewEdges(static_cast<int32>(vertexIndicesSize));
+	Description.ReserveNewPolygons(static_cast<int32>(faceVertexCountsSize));
+	Description.ReserveNewPolygonGroups(static_cast<int32>(faceRangesSize));
+
+	// Vertex instance ids of all face corners in order. The scratch array is reused by all meshes added on the same thread.
+	static thread_local TArray<FVertexInstanceID> CornerInstances;
+	CornerInstances.Reset(static_cast<int32>(vertexIndicesSize));
+
+	// With shared indices (see encoder option "shareVertexIndices") normals and uvs are indexed by the vertex indices as well. Every vertex
+	// then has exactly one vertex instance which is referenced by all its polygons. Otherwise every face corner gets its own vertex
+	// instance.
+	if (bSharedIndices)
 	{
-		const FVertexID VertexID = Description.CreateVertex();
-		VertexPositions[VertexID] = FVector(vtx[VertexIndex], vtx[VertexIndex + 2], vtx[VertexIndex + 1]) * PRT_TO_UE_SCALE;
+		for (int32 VertexIndex = 0; VertexIndex < NumVertices; ++VertexIndex)
+		{
+			Description.CreateVertexInstance(FVertexID(VertexIndex));
+		}
+		for (size_t CornerIndex = 0; CornerIndex < vertexIndicesSize; ++CornerIndex)
+		{
+			CornerInstances.Add(FVertexInstanceID(vertexIndices[CornerIndex]));
+		}
+	}
+	else
+	{
+		for (size_t CornerIndex = 0; CornerIndex < vertexIndicesSize; ++CornerIndex)
+		{
+			CornerInstances.Add(Description.CreateVertexInstance(FVertexID(vertexIndices[CornerIndex])));
+		}
+	}
+
+	// The vertex instance ids of a new mesh description are consecutive and start at zero, so the attributes can be written directly
+	FVector* Normals = Attributes.GetVertexInstanceNormals().GetRawArray().GetData();
+	if (bSharedIndices)
+	{
+		const int32 NumNormals = FMath::Min(NumVertices, static_cast<int32>(nrmSize / 3));
+		for (int32 InstanceIndex = 0; InstanceIndex < NumNormals; ++InstanceIndex)
+		{
+			Normals[InstanceIndex] = ToUnrealNormal(nrm + InstanceIndex * 3);
+		}
+
+		for (size_t UVSet = 0; UVSet < uvSets; ++UVSet)
+		{
+			FVector2D* UVs = VertexUVs.GetRawArray(UVSet).GetData();
+			const int32 NumUVs = FMath::Min(NumVertices, static_cast<int32>(uvsSizes[UVSet] / 2));
+			for (int32 InstanceIndex = 0; InstanceIndex < NumUVs; ++InstanceIndex)
+			{
+				UVs[InstanceIndex] = ToUnrealUV(uvs[UVSet] + InstanceIndex * 2);
+			}
+		}
+	}
+	else
+	{
+		check(normalIndicesSize == vertexIndicesSize);
+		for (size_t CornerIndex = 0; CornerIndex < vertexIndicesSize; ++CornerIndex)
+		{
+			const uint32_t NormalIndex = normalIndices[CornerIndex] * 3;
+			check(NormalIndex + 2 < nrmSize);
+			Normals[CornerIndex] = ToUnrealNormal(nrm + NormalIndex);
+		}
+
+		// Faces without uvs in a set keep the default uvs
+		for (size_t UVSet = 0; UVSet < uvSets; ++UVSet)
+		{
+			FVector2D* UVs = VertexUVs.GetRawArray(UVSet).GetData();
+			size_t BaseCornerIndex = 0;
+			size_t BaseUVIndex = 0;
+			for (size_t FaceIndex = 0; FaceIndex < faceVertexCountsSize; ++FaceIndex)
+			{
+				const size_t FaceVertexCount = faceVertexCounts[FaceIndex];
+				const size_t FaceUVCount = uvCounts[UVSet][FaceIndex];
+				if (FaceUVCount > 0)
+				{
+					check(FaceUVCount == FaceVertexCount);
+					for (size_t FaceVertexIndex = 0; FaceVertexIndex < FaceVertexCount; ++FaceVertexIndex)
+					{
+						const uint32_t UVIndex = uvIndices[UVSet][BaseUVIndex + FaceVertexIndex] * 2;
+						UVs[BaseCornerIndex + FaceVertexIndex] = ToUnrealUV(uvs[UVSet] + UVIndex);
+					}
+				}
+				BaseCornerIndex += FaceVertexCount;
+				BaseUVIndex += FaceUVCount;
+			}
+		}
 	}
 
 	// Create Polygons
 	size_t BaseVertexIndex = 0;
-	TArray<size_t> BaseUVIndex;
-	BaseUVIndex.Init(0, uvSets);
-
 	size_t PolygonGroupStartIndex = 0;
 	TArray<Vitruvio::FMaterialAttributeContainer> MeshMaterials;
+	MeshMaterials.Reserve(static_cast<int32>(faceRangesSize));
+	const auto MaterialSlotNames = Attributes.GetPolygonGroupMaterialSlotNames();
 	for (size_t PolygonGroupIndex = 0; PolygonGroupIndex < faceRangesSize; ++PolygonGroupIndex)
 	{
 		const size_t PolygonFaceCount = faceRanges[PolygonGroupIndex];
 
 		const FPolygonGroupID PolygonGroupId = Description.CreatePolygonGroup();
 
-		Vitruvio::FMaterialAttributeContainer MaterialContainer(materials[PolygonGroupIndex]);
-		const FName MaterialSlot = FName(MaterialContainer.Name);
-		Attributes.GetPolygonGroupMaterialSlotNames()[PolygonGroupId] = MaterialSlot;
+		const Vitruvio::FMaterialAttributeContainer& MaterialContainer = Result.Materials.FindChecked(materialIds[PolygonGroupIndex]);
+		MaterialSlotNames[PolygonGroupId] = FName(MaterialContainer.Name);
 		MeshMaterials.Add(MaterialContainer);
 
-		// Create Geometry
-		const auto Normals = Attributes.GetVertexInstanceNormals();
-		int PolygonFaces = 0;
 		for (size_t FaceIndex = 0; FaceIndex < PolygonFaceCount; ++FaceIndex)
 		{
 			check(PolygonGroupStartIndex + FaceIndex < faceVertexCountsSize);
 
 			const size_t FaceVertexCount = faceVertexCounts[PolygonGroupStartIndex + FaceIndex];
-			TArray<FVertexInstanceID> PolygonVertexInstances;
-
+			check(BaseVertexIndex + FaceVertexCount <= vertexIndicesSize);
 			if (FaceVertexCount >= 3)
 			{
-				for (size_t FaceVertexIndex = 0; FaceVertexIndex < FaceVertexCount; ++FaceVertexIndex)
-				{
-					check(BaseVertexIndex + FaceVertexIndex < vertexIndicesSize);
-					check(BaseVertexIndex + FaceVertexIndex < normalIndicesSize);
-
-					const uint32_t VertexIndex = vertexIndices[BaseVertexIndex + FaceVertexIndex];
-					const uint32_t NormalIndex = normalIndices[BaseVertexIndex + FaceVertexIndex] * 3;
-					FVertexInstanceID InstanceId = Description.CreateVertexInstance(FVertexID(VertexIndex));
-					PolygonVertexInstances.Add(InstanceId);
-
-					check(NormalIndex + 2 < nrmSize);
-					Normals[InstanceId] = FVector(nrm[NormalIndex], nrm[NormalIndex + 2], nrm[NormalIndex + 1]);
-
-					for (size_t UVSet = 0; UVSet < uvSets; ++UVSet)
-					{
-						if (uvCounts[UVSet][PolygonGroupStartIndex + FaceIndex] > 0)
-						{
-							check(uvCounts[UVSet][PolygonGroupStartIndex + FaceIndex] == FaceVertexCount);
-							const uint32_t UVIndex = uvIndices[UVSet][BaseUVIndex[UVSet] + FaceVertexIndex] * 2;
-							VertexUVs.Set(InstanceId, UVSet, FVector2D(uvs[UVSet][UVIndex], -uvs[UVSet][UVIndex + 1]));
-						}
-					}
-				}
-
+				const int32 NumPolygonVertexInstances = static_cast<int32>(FaceVertexCount);
+				const TArrayView<const FVertexInstanceID> PolygonVertexInstances(CornerInstances.GetData() + BaseVertexIndex, NumPolygonVertexInstances);
 				Description.CreatePolygon(PolygonGroupId, PolygonVertexInstances);
-				PolygonFaces++;
-				BaseVertexIndex += FaceVertexCount;
-				for (size_t UVSet = 0; UVSet < uvSets; ++UVSet)
-				{
-					BaseUVIndex[UVSet] += uvCounts[UVSet][PolygonGroupStartIndex + FaceIndex];
-				}
 			}
+			BaseVertexIndex += FaceVertexCount;
 		}
 
-		PolygonGroupStartIndex += PolygonFaces;
+		PolygonGroupStartIndex += PolygonFaceCount;
 	}
 
-	if (BaseVertexIndex > 0)
+	// Triangulated geometry (see encoder option "triangulate") contains the triangle indices of all material sections in order and can
+	// directly be used for collision
+	TArray<FTriIndices> TriangleIndices;
+	if (IsTriangulated(faceVertexCounts, faceVertexCountsSize) && vertexIndicesSize == faceVertexCountsSize * 3)
 	{
-		TSharedPtr<FVitruvioMesh> Mesh = MakeShared<FVitruvioMesh>(UriString, Description, MeshMaterials);
+		static_assert(sizeof(FTriIndices) == 3 * sizeof(uint32_t), "Triangle indices are expected to be tightly packed");
+		TriangleIndices.SetNumUninitialized(faceVertexCountsSize);
+		FMemory::Memcpy(TriangleIndices.GetData(), vertexIndices, vertexIndicesSize * sizeof(uint32_t));
+	}
+
+	if (Description.Polygons().Num() > 0)
+	{
+		TSharedPtr<FVitruvioMesh> Mesh = MakeShared<FVitruvioMesh>(UriString, MoveTemp(Description), MeshMaterials, Stats, MoveTemp(TriangleIndices));
+		Mesh->SetContentHash(ContentHash);
 
 		if (!UriString.IsEmpty())
 		{
 			Mesh = VitruvioModule::Get().GetMeshCache().InsertOrGet(UriString, Mesh);
 		}
+		else
+		{
+			Mesh = VitruvioModule::Get().GetMeshCache().InsertOrGetByContent(Mesh);
+		}
 		
-		Meshes.Add(prototypeId, Mesh);
-		Names.Add(prototypeId, NameString);
+		Result.Meshes.Add(prototypeId, Mesh);
+		Result.Names.Add(prototypeId, NameString);
 	}
 }
 
-void UnrealCallbacks::addInstance(int32_t prototypeId, const double* transform, const prt::AttributeMap** instanceMaterials,
+void UnrealCallbacks::addInstance(size_t isIndex, int32_t prototypeId, const double* transform, const int32_t* instanceMaterialIds,
 								  size_t numInstanceMaterials)
 {
 	const FMatrix TransformationMat(GetColumn(transform, 0), GetColumn(transform, 1), GetColumn(transform, 2), GetColumn(transform, 3));
@@ -205,7 +570,10 @@ void UnrealCallbacks::addInstance(int32_t prototypeId, const double* transform,
 	const FVector CEScale = FVector(Scale.X, Scale.Z, Scale.Y);
 	const FVector CETranslation = FVector(Translation.X, Translation.Z, Translation.Y) * PRT_TO_UE_SCALE;
 
-	if (!Meshes.Contains(prototypeId))
+	check(isIndex < static_cast<size_t>(Results.Num()));
+	FInitialShapeResult& Result = Results[isIndex];
+
+	if (!Result.Meshes.Contains(prototypeId))
 	{
 		UE_LOG(LogUnrealCallbacks, Warning, TEXT("No mesh found for prototypeId %d"), prototypeId);
 		return;
@@ -214,51 +582,115 @@ void UnrealCallbacks::addInstance(int32_t prototypeId, const double* transform,
 	const FTransform Transform(CERotation.GetNormalized(), CETranslation, CEScale);
 
 	TArray<Vitruvio::FMaterialAttributeContainer> MaterialOverrides;
-	if (instanceMaterials)
+	if (instanceMaterialIds)
 	{
+		MaterialOverrides.Reserve(numInstanceMaterials);
 		for (size_t MatIndex = 0; MatIndex < numInstanceMaterials; ++MatIndex)
 		{
-			Vitruvio::FMaterialAttributeContainer MaterialContainer(instanceMaterials[MatIndex]);
-			MaterialOverrides.Add(MaterialContainer);
+			MaterialOverrides.Add(Result.Materials.FindChecked(instanceMaterialIds[MatIndex]));
+		}
+	}
+
+	Result.Instances.FindOrAdd({prototypeId, MaterialOverrides}).Add(Transform);
+}
+
+void UnrealCallbacks::addMaterial(size_t isIndex, int32_t materialId, const prt::AttributeMap* material)
+{
+	check(isIndex < static_cast<size_t>(Results.Num()));
+	Results[isIndex].Materials.Add(materialId, Vitruvio::FMaterialAttributeContainer(material));
+}
+
+void UnrealCallbacks::addReports(size_t isIndex, const wchar_t* const* keys, size_t keysSize, const uint32_t* boolKeys, const bool* boolValues,
+								 size_t boolsSize, const uint32_t* floatKeys, const double* floatValues, size_t floatsSize, const uint32_t* stringKeys,
+								 const wchar_t* const* stringValues, size_t stringsSize)
+{
+	check(isIndex < static_cast<size_t>(Results.Num()));
+
+	TArray<FName> Keys;
+	Keys.Reserve(keysSize);
+	for (size_t KeyIndex = 0; KeyIndex < keysSize; ++KeyIndex)
+	{
+		Keys.Add(FName(keys[KeyIndex]));
+	}
+
+	Vitruvio::FReportMap& Reports = Results[isIndex].Reports;
+	Reports.BoolReports.Reserve(boolsSize);
+	for (size_t ReportIndex = 0; ReportIndex < boolsSize; ++ReportIndex)
+	{
+		Reports.BoolReports.Add(Keys[boolKeys[ReportIndex]], boolValues[ReportIndex]);
+	}
+	Reports.FloatReports.Reserve(floatsSize);
+	for (size_t ReportIndex = 0; ReportIndex < floatsSize; ++ReportIndex)
+	{
+		Reports.FloatReports.Add(Keys[floatKeys[ReportIndex]], floatValues[ReportIndex]);
+	}
+	Reports.StringReports.Reserve(stringsSize);
+	for (size_t ReportIndex = 0; ReportIndex < stringsSize; ++ReportIndex)
+	{
+		Reports.StringReports.Add(Keys[stringKeys[ReportIndex]], FString(stringValues[ReportIndex]));
+	}
+}
+
+bool UnrealCallbacks::isCanceled(size_t isIndex) const
+{
+	if (isIndex >= static_cast<size_t>(InvalidationTokens.Num()) || !InvalidationTokens[isIndex])
+	{
+		return false;
+	}
+	return InvalidationTokens[isIndex]->IsCancelRequested();
+}
+
+prt::Callbacks::Continuation UnrealCallbacks::progress(float /*percentageCompleted*/)
+{
+	if (InvalidationTokens.Num() == 0)
+	{
+		return CONTINUE;
+	}
+
+	for (int32 InitialShapeIndex = 0; InitialShapeIndex < InvalidationTokens.Num(); ++InitialShapeIndex)
+	{
+		if (!isCanceled(InitialShapeIndex))
+		{
+			return CONTINUE;
 		}
 	}
 
-	Instances.FindOrAdd({prototypeId, MaterialOverrides}).Add(Transform);
+	return CANCEL_ASAP;
 }
 
 prt::Status UnrealCallbacks::attrBool(size_t isIndex, int32_t shapeID, const wchar_t* key, bool value)
 {
-	AttributeMapBuilder->setBool(key, value);
+	AttributeMapBuilders[isIndex]->setBool(key, value);
 	return prt::STATUS_OK;
 }
 
 prt::Status UnrealCallbacks::attrFloat(size_t isIndex, int32_t shapeID, const wchar_t* key, double value)
 {
-	AttributeMapBuilder->setFloat(key, value);
+	AttributeMapBuilders[isIndex]->setFloat(key, value);
 	return prt::STATUS_OK;
 }
 
 prt::Status UnrealCallbacks::attrString(size_t isIndex, int32_t shapeID, const wchar_t* key, const wchar_t* value)
 {
-	AttributeMapBuilder->setString(key, value);
+	AttributeMapBuilders[isIndex]->setString(key, value);
 	return prt::STATUS_OK;
 }
 
 prt::Status UnrealCallbacks::attrBoolArray(size_t isIndex, int32_t shapeID, const wchar_t* key, const bool* values, size_t size, size_t nRows)
 {
-	AttributeMapBuilder->setBoolArray(key, values, size);
+	AttributeMapBuilders[isIndex]->setBoolArray(key, values, size);
 	return prt::STATUS_OK;
 }
 
 prt::Status UnrealCallbacks::attrFloatArray(size_t isIndex, int32_t shapeID, const wchar_t* key, const double* values, size_t size, size_t nRows)
 {
-	AttributeMapBuilder->setFloatArray(key, values, size);
+	AttributeMapBuilders[isIndex]->setFloatArray(key, values, size);
 	return prt::STATUS_OK;
 }
 
 prt::Status UnrealCallbacks::attrStringArray(size_t isIndex, int32_t shapeID, const wchar_t* key, const wchar_t* const* values, size_t size,
 											 size_t nRows)
 {
-	AttributeMapBuilder->setStringArray(key, values, size);
+	AttributeMapBuilders[isIndex]->setStringArray(key, values, size);
 	return prt::STATUS_OK;
 }
@@ -28,41 +28,115 @@
 
 DECLARE_LOG_CATEGORY_EXTERN(LogUnrealCallbacks, Log, All);
 
+class FInvalidationToken;
+
 class UnrealCallbacks final : public IUnrealCallbacks
 {
-	AttributeMapBuilderUPtr& AttributeMapBuilder;
+	struct FInitialShapeResult
+	{
+		Vitruvio::FInstanceMap Instances;
+		TMap<int32, TSharedPtr<FVitruvioMesh>> Meshes;
+		TMap<int32, FString> Names;
+
+		// Materials added by the encoder, referenced by id from meshes and instances
+		TMap<int32, Vitruvio::FMaterialAttributeContainer> Materials;
+
+		Vitruvio::FReportMap Reports;
+	};
+
+	// One attribute map builder and result per initial shape (indexed by isIndex)
+	AttributeMapBuilderVector& AttributeMapBuilders;
+	TArray<FInitialShapeResult> Results;
+
+	// Optional tokens (indexed by isIndex) which are polled to cancel the generation of results which are no longer needed
+	TArray<const FInvalidationToken*> InvalidationTokens;
+
+	// Buffers into which the encoder writes the geometry of the mesh currently being encoded for an initial shape (see allocateMesh). The
+	// vertex positions are written into the final mesh description. The other streams are per vertex instance and are written into scratch
+	// arrays which are reused for all meshes of the initial shape.
+	struct FMeshBuffers
+	{
+		bool bAllocated = false;
+		FMeshDescription Description;
+
+		TArray<float> Normals;
+		TArray<uint32_t> FaceVertexCounts;
+		TArray<uint32_t> VertexIndices;
+		TArray<uint32_t> NormalIndices;
+
+		TArray<TArray<float>> UVs;
+		TArray<TArray<uint32_t>> UVCounts;
+		TArray<TArray<uint32_t>> UVIndices;
+		TArray<float*> UVPtrs;
+		TArray<uint32_t*> UVCountPtrs;
+		TArray<uint32_t*> UVIndexPtrs;
+	};
+
+	// One set of mesh buffers per initial shape (indexed by isIndex)
+	TArray<FMeshBuffers> MeshBuffers;
 
-	Vitruvio::FInstanceMap Instances;
-	TMap<int32, TSharedPtr<FVitruvioMesh>> Meshes;
-	TMap<int32, FString> Names;
+	// Adds the mesh from the mesh cache if it has already been created for the given uri
+	bool AddCachedMesh(size_t isIndex, const wchar_t* name, int32_t prototypeId, const wchar_t* uri);
+
+	// Adds the mesh from the mesh cache if an identical mesh without uri has already been created. The positions are the vertex positions
+	// in Unreal space which are compared with the cached mesh on a hash hit. OutContentHash is set to the content hash of meshes without uri
+	// and to 0 otherwise.
+	template <typename T>
+	bool AddContentCachedMesh(size_t isIndex, const wchar_t* name, int32_t prototypeId, const wchar_t* uri, const T* vtx, size_t vtxSize, const T* nrm,
+							  size_t nrmSize, const uint32_t* faceVertexCounts, size_t faceVertexCountsSize, const uint32_t* vertexIndices,
+							  size_t vertexIndicesSize, const uint32_t* normalIndices, size_t normalIndicesSize, T const* const* uvs,
+							  size_t const* uvsSizes, uint32_t const* const* uvCounts, size_t const* uvCountsSizes, uint32_t const* const* uvIndices,
+							  size_t const* uvIndicesSizes, size_t uvSets, const uint32_t* faceRanges, size_t faceRangesSize,
+							  const int32_t* materialIds, bool bSharedIndices, const FVitruvioMeshStats& Stats, TArrayView<const FVector> Positions,
+							  uint64& OutContentHash);
+
+	// Shared implementation of the double (PRT space) and float (Unreal space) addMesh callbacks. The vertices have already been created.
+	template <typename T>
+	void AddMesh(size_t isIndex, const wchar_t* name, int32_t prototypeId, const wchar_t* uri, FMeshDescription&& Description, const T* nrm, size_t nrmSize,
+				 const uint32_t* faceVertexCounts, size_t faceVertexCountsSize, const uint32_t* vertexIndices, size_t vertexIndicesSize,
+				 const uint32_t* normalIndices, size_t normalIndicesSize, T const* const* uvs, size_t const* uvsSizes,
+				 uint32_t const* const* uvCounts, size_t const* uvCountsSizes, uint32_t const* const* uvIndices, size_t const* uvIndicesSizes,
+				 size_t uvSets, const uint32_t* faceRanges, size_t faceRangesSize, const int32_t* materialIds, bool bSharedIndices,
+				 const FVitruvioMeshStats& Stats, uint64 ContentHash);
 
 public:
 	virtual ~UnrealCallbacks() override = default;
-	UnrealCallbacks(AttributeMapBuilderUPtr& AttributeMapBuilder) : AttributeMapBuilder(AttributeMapBuilder) {}
+	UnrealCallbacks(AttributeMapBuilderVector& AttributeMapBuilders, TArray<const FInvalidationToken*> InvalidationTokens = {})
+		: AttributeMapBuilders(AttributeMapBuilders), InvalidationTokens(MoveTemp(InvalidationTokens))
+	{
+		Results.SetNum(AttributeMapBuilders.size());
+		MeshBuffers.SetNum(AttributeMapBuilders.size());
+	}
 
 	static const int32 NO_PROTOTYPE_INDEX = -1;
 
-	const Vitruvio::FInstanceMap& GetInstances() const
+	const Vitruvio::FInstanceMap& GetInstances(size_t InitialShapeIndex = 0) const
+	{
+		return Results[InitialShapeIndex].Instances;
+	}
+
+	TSharedPtr<FVitruvioMesh> GetMeshById(int32 PrototypeId, size_t InitialShapeIndex = 0) const
 	{
-		return Instances;
+		return Results[InitialShapeIndex].Meshes[PrototypeId];
 	}
 
-	TSharedPtr<FVitruvioMesh> GetMeshById(int32 PrototypeId) const
+	const TMap<int32, TSharedPtr<FVitruvioMesh>>& GetMeshes(size_t InitialShapeIndex = 0) const
 	{
-		return Meshes[PrototypeId];
+		return Results[InitialShapeIndex].Meshes;
 	}
 
-	const TMap<int32, TSharedPtr<FVitruvioMesh>>& GetMeshes() const
+	const TMap<int32, FString>& GetNames(size_t InitialShapeIndex = 0) const
 	{
-		return Meshes;
+		return Results[InitialShapeIndex].Names;
 	}
 
-	const TMap<int32, FString>& GetNames() const
+	const Vitruvio::FReportMap& GetReports(size_t InitialShapeIndex = 0) const
 	{
-		return Names;
+		return Results[InitialShapeIndex].Reports;
 	}
 
 	/**
+	 * @param isIndex initial shape index (relative to the initialShapes array in the generate() call)
 	 * @param name initial shape name, optionally used to create primitive groups on output
 	 * @param prototypeId the id of the prototype or -1 of not cached
 	 * @param uri
@@ -77,11 +151,11 @@ public:
 	 * @param uvs array of texture coordinate arrays (same indexing as vertices per uv set)
 	 * @param uvsSizes lengths of uv arrays per uv set
 	 * @param faceRanges ranges for materials and reports
-	 * @param materials contains faceRangesSize-1 attribute maps (all materials must have an identical set of keys and
-	 * types)
+	 * @param materialIds contains faceRangesSize ids of materials previously added with addMaterial
+	 * @param stats bounds and element counts of the mesh
 	 */
 	// clang-format off
-	void addMesh(const wchar_t* name,
+	void addMesh(size_t isIndex, const wchar_t* name,
 		int32_t prototypeId, const wchar_t* uri,
 		const double* vtx, size_t vtxSize,
 		const double* nrm, size_t nrmSize,
@@ -95,23 +169,65 @@ public:
 		size_t uvSets,
 
 		const uint32_t* faceRanges, size_t faceRangesSize,
-		const prt::AttributeMap** materials
+		const int32_t* materialIds,
+		const UnrealMeshStats& stats
+	) override;
+
+	void addMesh(size_t isIndex, const wchar_t* name,
+		int32_t prototypeId, const wchar_t* uri,
+		const float* vtx, size_t vtxSize,
+		const float* nrm, size_t nrmSize,
+		const uint32_t* faceVertexCounts, size_t faceVertexCountsSize,
+		const uint32_t* vertexIndices, size_t vertexIndicesSize,
+		const uint32_t* normalIndices, size_t normalIndicesSize,
+
+		float const* const* uvs, size_t const* uvsSizes,
+		uint32_t const* const* uvCounts, size_t const* uvCountsSizes,
+		uint32_t const* const* uvIndices, size_t const* uvIndicesSizes,
+		size_t uvSets,
+
+		const uint32_t* faceRanges, size_t faceRangesSize,
+		const int32_t* materialIds,
+		const UnrealMeshStats& stats
 	) override;
 	// clang-format on
 
+	bool allocateMesh(size_t isIndex, const wchar_t* name, int32_t prototypeId, const wchar_t* uri, const UnrealMeshSizes& sizes,
+					  UnrealMeshBuffers& buffers) override;
+
 	/**
 	 * Add a new instance with a given id, transform and optional set of overriding attributes for this instance
 	 *
+	 * @param isIndex initial shape index (relative to the initialShapes array in the generate() call)
 	 * @param prototypeId the id of the prorotype. An @ref addMesh call with the specified prorotypeId will be called before
 	 *                    the call to addInstance
 	 * @param transform the transformation matrix of this instance
-	 * @param instanceMaterial override materials for this instance
+	 * @param instanceMaterialIds ids of the override materials for this instance, previously added with addMaterial
 	 * @param numInstanceMaterials number of instance material overrides. Is either 0 or is equal to the number
 	 *                             of materials of the original mesh (by prototypeId)
 	 */
-	virtual void addInstance(int32_t prototypeId, const double* transform, const prt::AttributeMap** instanceMaterial,
+	virtual void addInstance(size_t isIndex, int32_t prototypeId, const double* transform, const int32_t* instanceMaterialIds,
 							 size_t numInstanceMaterials) override;
 
+	/**
+	 * Converts the material once so that it can be shared by all meshes and instances referencing it.
+	 */
+	void addMaterial(size_t isIndex, int32_t materialId, const prt::AttributeMap* material) override;
+
+	/**
+	 * Converts every report key to an FName once and stores the reports with the result of the initial shape.
+	 */
+	void addReports(size_t isIndex, const wchar_t* const* keys, size_t keysSize, const uint32_t* boolKeys, const bool* boolValues, size_t boolsSize,
+					const uint32_t* floatKeys, const double* floatValues, size_t floatsSize, const uint32_t* stringKeys,
+					const wchar_t* const* stringValues, size_t stringsSize) override;
+
+	bool isCanceled(size_t isIndex) const override;
+
+	/**
+	 * Cancels the generate call as soon as possible once the results of all initial shapes are no longer needed.
+	 */
+	Continuation progress(float percentageCompleted) override;
+
 	prt::Status generateError(size_t /*isIndex*/, prt::Status /*status*/, const wchar_t* message) override
 	{
 		UE_LOG(LogUnrealCallbacks, Error, TEXT("GENERATE ERROR: %s"), message)
@@ -243,7 +243,8 @@ UMaterialInstanceDynamic* GameThread_CreateMaterialInstance(UObject* Outer, cons
 	TMap<FString, FGraphEventRef> TexturePropertyTasks;
 	TMap<FString, TFuture<FTextureData>> TextureProperties;
 
-	FCriticalSection CacheCriticalSection;
+	// Textures are usually already decoded by the generate pipeline on the Vitruvio texture pool, which shares this lock
+	FCriticalSection& CacheCriticalSection = VitruvioModule::Get().GetTextureCacheLock();
 
 	for (const auto& TextureProperty : MaterialContainer.TextureProperties)
 	{
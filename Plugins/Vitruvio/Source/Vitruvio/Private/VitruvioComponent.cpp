@@ -25,7 +25,6 @@
 
 #include "Components/HierarchicalInstancedStaticMeshComponent.h"
 #include "Components/SplineComponent.h"
-#include "Engine/CollisionProfile.h"
 #include "Engine/StaticMeshActor.h"
 #include "ObjectEditorUtils.h"
 #include "PhysicsEngine/BodySetup.h"
@@ -41,6 +40,45 @@
 namespace
 {
 
+EQueuedWorkPriority GetWorkPriority(const UActorComponent* Component)
+{
+#if WITH_EDITOR
+	// Interactive edits of selected actors are scheduled ahead of background work (eg. generating all actors after loading a level)
+	const AActor* Owner = Component->GetOwner();
+	if (Owner && Owner->IsSelected())
+	{
+		return EQueuedWorkPriority::High;
+	}
+#endif
+	return EQueuedWorkPriority::Normal;
+}
+
+// Game thread time per frame which all components together spend on finishing mesh builds (see FVitruvioMesh::TryFinishBuild) and on
+// applying cooked collision
+constexpr double MESH_BUILD_FRAME_BUDGET_SECONDS = 0.004;
+
+uint64 MeshBuildBudgetFrame = 0;
+double MeshBuildBudgetUsed = 0.0;
+
+// Components whose background generate calls (eg. after loading a level or reimporting a rule package) are issued together in the next frame
+TArray<TWeakObjectPtr<UVitruvioComponent>> PendingBatchGenerates;
+uint64 PendingBatchGeneratesFrame = 0;
+
+bool HasMeshBuildBudget()
+{
+	if (MeshBuildBudgetFrame != GFrameCounter)
+	{
+		MeshBuildBudgetFrame = GFrameCounter;
+		MeshBuildBudgetUsed = 0.0;
+	}
+	return MeshBuildBudgetUsed < MESH_BUILD_FRAME_BUDGET_SECONDS;
+}
+
+void ConsumeMeshBuildBudget(double Seconds)
+{
+	MeshBuildBudgetUsed += Seconds;
+}
+
 FVector GetCentroid(const TArray<FVector>& Vertices)
 {
 	FVector Centroid = FVector::ZeroVector;
@@ -74,6 +112,22 @@ bool GetAttribute(const TMap<FString, URuleAttribute*>& Attributes, const FStrin
 	return true;
 }
 
+template <typename T, typename R>
+bool GetReport(const TMap<FName, R>& Reports, const FString& Name, T& OutValue)
+{
+	// Names which have never been used as a report key do not exist as FName
+	const FName Key(*Name, FNAME_Find);
+	R const* FoundReport = Key.IsNone() ? nullptr : Reports.Find(Key);
+	if (!FoundReport)
+	{
+		OutValue = T();
+		return false;
+	}
+
+	OutValue = static_cast<T>(*FoundReport);
+	return true;
+}
+
 template <typename A, typename T>
 bool SetAttribute(UVitruvioComponent* VitruvioComponent, TMap<FString, URuleAttribute*>& Attributes, const FString& Name, const T& Value)
 {
@@ -121,27 +175,18 @@ bool IsOuterOf(UObject* Inner, UObject* Outer)
 	return false;
 }
 
-void InitializeBodySetup(UBodySetup* BodySetup, bool GenerateComplexCollision)
+void ApplyCollision(UBodySetup* BodySetup, UStaticMeshComponent* StaticMeshComponent)
 {
-	BodySetup->DefaultInstance.SetCollisionProfileName(UCollisionProfile::BlockAll_ProfileName);
-	BodySetup->CollisionTraceFlag =
-		GenerateComplexCollision ? ECollisionTraceFlag::CTF_UseComplexAsSimple : ECollisionTraceFlag::CTF_UseSimpleAsComplex;
-	BodySetup->bDoubleSidedGeometry = true;
-	BodySetup->bMeshCollideAll = true;
-	BodySetup->InvalidatePhysicsData();
-	BodySetup->CreatePhysicsMeshes();
-}
-
-void CreateCollision(UStaticMesh* Mesh, UStaticMeshComponent* StaticMeshComponent, bool ComplexCollision)
-{
-	if (!Mesh)
+	// The cooked body setup is shared by all components which use the mesh with the same collision mode. It is set on the component
+	// instead of the shared static mesh so that components with different collision modes do not override each other.
+	if (UGeneratedModelStaticMeshComponent* ModelComponent = Cast<UGeneratedModelStaticMeshComponent>(StaticMeshComponent))
 	{
-		return;
+		ModelComponent->SetCollisionBodySetup(BodySetup);
+	}
+	else if (UGeneratedModelHISMComponent* InstancedComponent = Cast<UGeneratedModelHISMComponent>(StaticMeshComponent))
+	{
+		InstancedComponent->SetCollisionBodySetup(BodySetup);
 	}
-
-	UBodySetup* BodySetup = NewObject<UBodySetup>(StaticMeshComponent, NAME_None, RF_Transient | RF_DuplicateTransient | RF_TextExportTransient);
-	InitializeBodySetup(BodySetup, ComplexCollision);
-	Mesh->SetBodySetup(BodySetup);
 	StaticMeshComponent->RecreatePhysicsState();
 }
 
@@ -275,6 +320,26 @@ URulePackage* UVitruvioComponent::GetRpk() const
 	return Rpk;
 }
 
+bool UVitruvioComponent::GetStringReport(const FString& Name, FString& OutValue) const
+{
+	return GetReport(Reports.StringReports, Name, OutValue);
+}
+
+bool UVitruvioComponent::GetBoolReport(const FString& Name, bool& OutValue) const
+{
+	return GetReport(Reports.BoolReports, Name, OutValue);
+}
+
+bool UVitruvioComponent::GetFloatReport(const FString& Name, float& OutValue) const
+{
+	return GetReport(Reports.FloatReports, Name, OutValue);
+}
+
+const Vitruvio::FReportMap& UVitruvioComponent::GetReports() const
+{
+	return Reports;
+}
+
 void UVitruvioComponent::SetRandomSeed(int32 NewRandomSeed)
 {
 	RandomSeed = NewRandomSeed;
@@ -363,16 +428,33 @@ void UVitruvioComponent::OnComponentCreated()
 	}
 }
 
-void UVitruvioComponent::ProcessGenerateQueue()
+void UVitruvioComponent::ProcessGenerateQueue(bool bWaitForBuild)
 {
 	if (!GenerateQueue.IsEmpty())
 	{
-		// Get from queue and build meshes
+		// Get from queue and start building the meshes. A newer result replaces the one which is currently being built.
 		FGenerateResultDescription Result;
 		GenerateQueue.Dequeue(Result);
 
+		// Attributes which have been evaluated in the same generate call
+		if (Result.EvaluatedAttributes)
+		{
+			UpdateAttributes(Result.EvaluatedAttributes);
+		}
+
+		BeginBuildResult(Result, VitruvioModule::Get().GetMaterialCache(), VitruvioModule::Get().GetTextureCache());
+		PendingBuildResult = MoveTemp(Result);
+	}
+
+	if (PendingBuildResult.IsSet() && FinishBuildResult(PendingBuildResult.GetValue(), bWaitForBuild))
+	{
+		FGenerateResultDescription Result = MoveTemp(PendingBuildResult.GetValue());
+		PendingBuildResult.Reset();
+
+		Reports = MoveTemp(Result.Reports);
+
 		FConvertedGenerateResult ConvertedResult =
-			BuildResult(Result, VitruvioModule::Get().GetMaterialCache(), VitruvioModule::Get().GetTextureCache());
+			ConvertResult(Result, VitruvioModule::Get().GetMaterialCache(), VitruvioModule::Get().GetTextureCache());
 
 		QUICK_SCOPE_CYCLE_COUNTER(STAT_VitruvioActor_CreateModelActors);
 
@@ -411,16 +493,16 @@ void UVitruvioComponent::ProcessGenerateQueue()
 			VitruvioModelComponent->RegisterComponent();
 		}
 
+		// The collision of the previous model is replaced once the collision of the new model has been cooked
+		VitruvioModelComponent->SetCollisionBodySetup(nullptr);
 		if (ConvertedResult.ShapeMesh)
 		{
 			VitruvioModelComponent->SetStaticMesh(ConvertedResult.ShapeMesh->GetStaticMesh());
-			VitruvioModelComponent->SetCollisionData(ConvertedResult.ShapeMesh->GetCollisionData());
-			CreateCollision(ConvertedResult.ShapeMesh->GetStaticMesh(), VitruvioModelComponent, GenerateCollision);
+			PendingCollisions.Add({VitruvioModelComponent, ConvertedResult.ShapeMesh, GenerateCollision});
 		}
 		else
 		{
 			VitruvioModelComponent->SetStaticMesh(nullptr);
-			VitruvioModelComponent->SetCollisionData({});
 		}
 
 		TMap<FString, int32> NameMap;
@@ -431,7 +513,6 @@ void UVitruvioComponent::ProcessGenerateQueue()
 																			  RF_Transient | RF_TextExportTransient | RF_DuplicateTransient);
 			const TArray<FTransform>& Transforms = Instance.Transforms;
 			InstancedComponent->SetStaticMesh(Instance.InstanceMesh->GetStaticMesh());
-			InstancedComponent->SetCollisionData(Instance.InstanceMesh->GetCollisionData());
 
 			// Add all instance transforms
 			for (const FTransform& Transform : Transforms)
@@ -446,7 +527,7 @@ void UVitruvioComponent::ProcessGenerateQueue()
 			}
 
 			// Instanced component collision
-			CreateCollision(Instance.InstanceMesh->GetStaticMesh(), InstancedComponent, GenerateCollision);
+			PendingCollisions.Add({InstancedComponent, Instance.InstanceMesh, GenerateCollision});
 
 			// Attach and register instance component
 			InstancedComponent->AttachToComponent(VitruvioModelComponent, FAttachmentTransformRules::KeepRelativeTransform);
@@ -463,27 +544,49 @@ void UVitruvioComponent::ProcessGenerateQueue()
 	}
 }
 
-void UVitruvioComponent::ProcessAttributesEvaluationQueue()
+void UVitruvioComponent::FinishPendingBuild()
 {
-	if (!AttributesEvaluationQueue.IsEmpty())
-	{
-		FAttributesEvaluation AttributesEvaluation;
-		AttributesEvaluationQueue.Dequeue(AttributesEvaluation);
-		TMap<FString, URuleAttribute*> OldAttributes = Attributes;
-		Attributes = AttributesEvaluation.AttributeMap->ConvertToUnrealAttributeMap(this);
+	ProcessGenerateQueue(true);
+}
 
-		for (auto Attribute : Attributes)
+void UVitruvioComponent::ProcessPendingCollisions()
+{
+	// The models are visible right away, their collision is swapped in once it has been cooked
+	for (int32 PendingIndex = 0; PendingIndex < PendingCollisions.Num();)
+	{
+		const FPendingCollision& PendingCollision = PendingCollisions[PendingIndex];
+		UStaticMeshComponent* StaticMeshComponent = PendingCollision.Component.Get();
+		if (StaticMeshComponent)
 		{
-			if (OldAttributes.Contains(Attribute.Key) && OldAttributes[Attribute.Key]->bUserSet)
+			UBodySetup* BodySetup = PendingCollision.Mesh->GetBodySetup(PendingCollision.bComplexCollision);
+			if (!BodySetup)
 			{
-				Attribute.Value->CopyValue(OldAttributes[Attribute.Key]);
-				Attribute.Value->bUserSet = true;
+				++PendingIndex;
+				continue;
 			}
+
+			if (!HasMeshBuildBudget())
+			{
+				return;
+			}
+
+			const double StartTime = FPlatformTime::Seconds();
+			ApplyCollision(BodySetup, StaticMeshComponent);
+			ConsumeMeshBuildBudget(FPlatformTime::Seconds() - StartTime);
 		}
 
-		bAttributesReady = true;
+		PendingCollisions.RemoveAtSwap(PendingIndex);
+	}
+}
 
-		bNotifyAttributeChange = true;
+void UVitruvioComponent::ProcessAttributesEvaluationQueue()
+{
+	if (!AttributesEvaluationQueue.IsEmpty())
+	{
+		FAttributesEvaluation AttributesEvaluation;
+		AttributesEvaluationQueue.Dequeue(AttributesEvaluation);
+
+		UpdateAttributes(AttributesEvaluation.AttributeMap);
 
 		if (GenerateAutomatically || AttributesEvaluation.bForceRegenerate)
 		{
@@ -492,9 +595,31 @@ void UVitruvioComponent::ProcessAttributesEvaluationQueue()
 	}
 }
 
+void UVitruvioComponent::UpdateAttributes(const FAttributeMapPtr& AttributeMap)
+{
+	TMap<FString, URuleAttribute*> OldAttributes = Attributes;
+	Attributes = AttributeMap->ConvertToUnrealAttributeMap(this);
+
+	for (auto Attribute : Attributes)
+	{
+		if (OldAttributes.Contains(Attribute.Key) && OldAttributes[Attribute.Key]->bUserSet)
+		{
+			Attribute.Value->CopyValue(OldAttributes[Attribute.Key]);
+			Attribute.Value->bUserSet = true;
+		}
+	}
+
+	bAttributesReady = true;
+
+	bNotifyAttributeChange = true;
+}
+
 void UVitruvioComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
 {
+	ProcessRegenerateRequest();
+	FlushBatchGenerates();
 	ProcessGenerateQueue();
+	ProcessPendingCollisions();
 	ProcessAttributesEvaluationQueue();
 
 	if (bNotifyAttributeChange)
@@ -504,6 +629,22 @@ void UVitruvioComponent::TickComponent(float DeltaTime, ELevelTick TickType, FAc
 	}
 }
 
+void UVitruvioComponent::ProcessRegenerateRequest()
+{
+	if (!bRegenerateRequested.AtomicSet(false))
+	{
+		return;
+	}
+
+	// If attributes have been requested by the canceled call (or while it was running) they are evaluated again
+	if (bRegenerateEvaluateAttributes.AtomicSet(false) || bEvaluateAttributesOnRegenerate)
+	{
+		bEvaluateAttributesOnRegenerate = false;
+		bAttributesReady = false;
+	}
+	Generate();
+}
+
 void UVitruvioComponent::NotifyAttributesChanged()
 {
 #if WITH_EDITOR
@@ -530,20 +671,52 @@ void UVitruvioComponent::RemoveGeneratedMeshes()
 	}
 
 	HasGeneratedMesh = false;
+	PendingBuildResult.Reset();
+	PendingCollisions.Empty();
+	Reports = {};
 	InitialShape->SetHidden(false);
 }
 
-FConvertedGenerateResult UVitruvioComponent::BuildResult(FGenerateResultDescription& GenerateResult,
-														 TMap<Vitruvio::FMaterialAttributeContainer, UMaterialInstanceDynamic*>& MaterialCache,
-														 TMap<FString, Vitruvio::FTextureData>& TextureCache)
+void UVitruvioComponent::BeginBuildResult(FGenerateResultDescription& GenerateResult,
+										  TMap<Vitruvio::FMaterialAttributeContainer, UMaterialInstanceDynamic*>& MaterialCache,
+										  TMap<FString, Vitruvio::FTextureData>& TextureCache)
 {
-	// build all meshes
+	// Meshes shared with other results (see FMeshCache) might already be built or being built
 	for (auto& IdAndMesh : GenerateResult.Meshes)
 	{
 		FString Name = GenerateResult.Names[IdAndMesh.Key];
-		IdAndMesh.Value->Build(Name, MaterialCache, TextureCache, OpaqueParent, MaskedParent, TranslucentParent);
+		IdAndMesh.Value->BeginBuild(Name, MaterialCache, TextureCache, OpaqueParent, MaskedParent, TranslucentParent);
+	}
+}
+
+bool UVitruvioComponent::FinishBuildResult(FGenerateResultDescription& GenerateResult, bool bWait)
+{
+	bool bAllBuilt = true;
+	for (auto& IdAndMesh : GenerateResult.Meshes)
+	{
+		const TSharedPtr<FVitruvioMesh>& Mesh = IdAndMesh.Value;
+		if (Mesh->IsBuilt())
+		{
+			continue;
+		}
+
+		if (!bWait && !HasMeshBuildBudget())
+		{
+			return false;
+		}
+
+		const double StartTime = FPlatformTime::Seconds();
+		bAllBuilt &= Mesh->TryFinishBuild(bWait);
+		ConsumeMeshBuildBudget(FPlatformTime::Seconds() - StartTime);
 	}
 
+	return bAllBuilt;
+}
+
+FConvertedGenerateResult UVitruvioComponent::ConvertResult(FGenerateResultDescription& GenerateResult,
+														   TMap<Vitruvio::FMaterialAttributeContainer, UMaterialInstanceDynamic*>& MaterialCache,
+														   TMap<FString, Vitruvio::FTextureData>& TextureCache)
+{
 	// convert instances
 	TArray<FInstance> Instances;
 	for (const auto& Instance : GenerateResult.Instances)
@@ -604,43 +777,129 @@ void UVitruvioComponent::Generate()
 		return;
 	}
 
-	// Since we can not abort an ongoing generate call from PRT, we invalidate the result and regenerate after the current generate call has
-	// completed.
+	GenerateInternal(false);
+}
+
+void UVitruvioComponent::GenerateInternal(bool bEvaluateAttributes)
+{
+	// Requesting a regenerate cancels the ongoing generate call as soon as possible. We regenerate after it has returned.
 	if (GenerateToken)
 	{
+		bEvaluateAttributesOnRegenerate |= bEvaluateAttributes;
 		GenerateToken->RequestRegenerate();
 
 		return;
 	}
 
+	// A canceled generate call is repeated on the next tick with the current input data anyway
+	if (bRegenerateRequested)
+	{
+		bEvaluateAttributesOnRegenerate |= bEvaluateAttributes;
+		return;
+	}
+
+	// The batched generate call reads the current input data, it only needs to know whether the attributes have to be evaluated as well
+	if (bBatchGeneratePending)
+	{
+		bBatchGenerateEvaluateAttributes |= bEvaluateAttributes;
+		return;
+	}
+
 	if (InitialShape)
 	{
+		const EQueuedWorkPriority Priority = GetWorkPriority(this);
+		// Background work is collected and issued in a single batch with the generate calls of other components
+		if (Priority == EQueuedWorkPriority::Normal)
+		{
+			if (PendingBatchGenerates.Num() == 0)
+			{
+				PendingBatchGeneratesFrame = GFrameCounter;
+			}
+			PendingBatchGenerates.Add(this);
+			bBatchGeneratePending = true;
+			bBatchGenerateEvaluateAttributes = bEvaluateAttributes;
+			return;
+		}
+
+		VitruvioModule& Module = VitruvioModule::Get();
 		FGenerateResult GenerateResult =
-			VitruvioModule::Get().GenerateAsync(InitialShape->GetFaces(), Rpk, Vitruvio::CreateAttributeMap(Attributes), RandomSeed);
+			bEvaluateAttributes
+				? Module.GenerateAndEvaluateRuleAttributesAsync(InitialShape->GetFaces(), Rpk, Vitruvio::CreateAttributeMap(Attributes), RandomSeed,
+																Priority)
+				: Module.GenerateAsync(InitialShape->GetFaces(), Rpk, Vitruvio::CreateAttributeMap(Attributes), RandomSeed, Priority);
+
+		HandleGenerateResult(MoveTemp(GenerateResult), bEvaluateAttributes);
+	}
+}
 
-		GenerateToken = GenerateResult.Token;
+void UVitruvioComponent::FlushBatchGenerates()
+{
+	// Generate calls collected during the current frame are kept until the next frame so that all components of a level end up in one batch
+	if (PendingBatchGenerates.Num() == 0 || PendingBatchGeneratesFrame == GFrameCounter)
+	{
+		return;
+	}
 
-		// clang-format off
-		GenerateResult.Result.Next([this](const FGenerateResult::ResultType& Result)
+	TArray<UVitruvioComponent*> Components;
+	TArray<FGenerateRequest> Requests;
+	for (const TWeakObjectPtr<UVitruvioComponent>& PendingComponent : PendingBatchGenerates)
+	{
+		UVitruvioComponent* Component = PendingComponent.Get();
+		if (!Component || !Component->bBatchGeneratePending)
 		{
-			FScopeLock Lock(&Result.Token->Lock);
+			continue;
+		}
 
-			if (Result.Token->IsInvalid()) {
-				return;
-			}
+		Component->bBatchGeneratePending = false;
+		if (!Component->InitialShape || !Component->Rpk)
+		{
+			continue;
+		}
 
-			GenerateToken.Reset();
-			if (Result.Token->IsRegenerateRequested())
-			{
-				Generate();
-			}
-			else
+		Requests.Add({Component->InitialShape->GetFaces(), Component->Rpk, Vitruvio::CreateAttributeMap(Component->Attributes),
+					  Component->RandomSeed, Component->bBatchGenerateEvaluateAttributes});
+		Components.Add(Component);
+	}
+	PendingBatchGenerates.Reset();
+
+	TArray<FGenerateResult> Results = VitruvioModule::Get().GenerateBatchAsync(MoveTemp(Requests));
+	for (int32 ComponentIndex = 0; ComponentIndex < Components.Num(); ++ComponentIndex)
+	{
+		Components[ComponentIndex]->HandleGenerateResult(MoveTemp(Results[ComponentIndex]),
+														 Components[ComponentIndex]->bBatchGenerateEvaluateAttributes);
+	}
+}
+
+void UVitruvioComponent::HandleGenerateResult(FGenerateResult GenerateResult, bool bEvaluateAttributes)
+{
+	GenerateToken = GenerateResult.Token;
+
+	// clang-format off
+	GenerateResult.Result.Next([this, bEvaluateAttributes](const FGenerateResult::ResultType& Result)
+	{
+		FScopeLock Lock(&Result.Token->Lock);
+
+		if (Result.Token->IsInvalid()) {
+			return;
+		}
+
+		GenerateToken.Reset();
+		if (Result.Token->IsRegenerateRequested())
+		{
+			// The input data may only be accessed on the game thread, so the regenerate is issued from the next tick (see
+			// ProcessRegenerateRequest)
+			if (bEvaluateAttributes)
 			{
-				GenerateQueue.Enqueue(Result.Value);
+				bRegenerateEvaluateAttributes = true;
 			}
-		});
-		// clang-format on
-	}
+			bRegenerateRequested = true;
+		}
+		else
+		{
+			GenerateQueue.Enqueue(Result.Value);
+		}
+	});
+	// clang-format on
 }
 
 #if WITH_EDITOR
@@ -750,8 +1009,22 @@ void UVitruvioComponent::EvaluateRuleAttributes(bool ForceRegenerate)
 	check(Rpk);
 	check(InitialShape);
 
-	// Since we can not abort an ongoing generate call from PRT, we invalidate the result and evaluate the attributes again after the current request
-	// has completed.
+	// If we generate afterwards anyway, evaluate the attributes in the same generate call
+	if (GenerateAutomatically || ForceRegenerate)
+	{
+		if (EvalAttributesInvalidationToken)
+		{
+			EvalAttributesInvalidationToken->Invalidate();
+			EvalAttributesInvalidationToken.Reset();
+		}
+
+		bAttributesReady = false;
+
+		GenerateInternal(true);
+		return;
+	}
+
+	// Requesting a re-evaluation cancels the ongoing evaluation as soon as possible. We evaluate the attributes again after it has returned.
 	if (EvalAttributesInvalidationToken)
 	{
 		EvalAttributesInvalidationToken->RequestReEvaluateAttributes();
@@ -760,7 +1033,8 @@ void UVitruvioComponent::EvaluateRuleAttributes(bool ForceRegenerate)
 
 	bAttributesReady = false;
 
-	FAttributeMapResult AttributesResult = VitruvioModule::Get().EvaluateRuleAttributesAsync(InitialShape->GetFaces(), Rpk, Vitruvio::CreateAttributeMap(Attributes), RandomSeed);
+	FAttributeMapResult AttributesResult = VitruvioModule::Get().EvaluateRuleAttributesAsync(
+		InitialShape->GetFaces(), Rpk, Vitruvio::CreateAttributeMap(Attributes), RandomSeed, GetWorkPriority(this));
 
 	EvalAttributesInvalidationToken = AttributesResult.Token;
 
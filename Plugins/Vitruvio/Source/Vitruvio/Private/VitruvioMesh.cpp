@@ -1,8 +1,11 @@
 #include "VitruvioMesh.h"
+#include "GeneratedModelCollision.h"
 #include "VitruvioModule.h"
 #include "MaterialConversion.h"
 #include "StaticMeshAttributes.h"
 
+#include "Async/Async.h"
+
 UMaterialInstanceDynamic* CacheMaterial(UMaterial* OpaqueParent, UMaterial* MaskedParent, UMaterial* TranslucentParent,
                                         TMap<FString, Vitruvio::FTextureData>& TextureCache,
                                         TMap<Vitruvio::FMaterialAttributeContainer, UMaterialInstanceDynamic*>& MaterialCache,
@@ -26,18 +29,24 @@ UMaterialInstanceDynamic* CacheMaterial(UMaterial* OpaqueParent, UMaterial* Mask
 FVitruvioMesh::~FVitruvioMesh()
 {
 	VitruvioModule* VitruvioModule = VitruvioModule::GetUnchecked();
+	// The worker thread accesses this mesh until the render data has been built
+	if (RenderDataBuild.IsValid())
+	{
+		RenderDataBuild.Wait();
+	}
+
 	if (StaticMesh && VitruvioModule)
 	{
 		VitruvioModule->UnregisterMesh(StaticMesh);
 	}
 }
 
-void FVitruvioMesh::Build(const FString& Name, TMap<Vitruvio::FMaterialAttributeContainer, UMaterialInstanceDynamic*>& MaterialCache,
-						  TMap<FString, Vitruvio::FTextureData>& TextureCache, UMaterial* OpaqueParent, UMaterial* MaskedParent,
-						  UMaterial* TranslucentParent)
+void FVitruvioMesh::BeginBuild(const FString& Name, TMap<Vitruvio::FMaterialAttributeContainer, UMaterialInstanceDynamic*>& MaterialCache,
+							   TMap<FString, Vitruvio::FTextureData>& TextureCache, UMaterial* OpaqueParent, UMaterial* MaskedParent,
+							   UMaterial* TranslucentParent)
 {
 	check(IsInGameThread());
-	
+
 	if (StaticMesh)
 	{
 		return;
@@ -46,64 +55,121 @@ void FVitruvioMesh::Build(const FString& Name, TMap<Vitruvio::FMaterialAttribute
 	FString MeshName = Name.Replace(TEXT("."), TEXT(""));
 	const FName StaticMeshName = MakeUniqueObjectName(nullptr, UStaticMesh::StaticClass(), FName(MeshName));
 	StaticMesh = NewObject<UStaticMesh>(GetTransientPackage(), StaticMeshName, RF_Transient | RF_DuplicateTransient | RF_TextExportTransient);
+	StaticMesh->NeverStream = true;
 	VitruvioModule::Get().RegisterMesh(StaticMesh);
-	
+
 	TMap<UMaterialInstanceDynamic*, FName> MaterialSlots;
 
 	FStaticMeshAttributes MeshAttributes(MeshDescription);
-
-	TArray<FVector> Vertices;
-	auto VertexPositions = MeshAttributes.GetVertexPositions();
-	for (int32 VertexIndex = 0; VertexIndex < VertexPositions.GetNumElements(); ++VertexIndex)
-	{
-		Vertices.Add(VertexPositions[FVertexID(VertexIndex)]);
-	}
-
-	TArray<FTriIndices> Indices;
-	const auto PolygonGroups = MeshDescription.PolygonGroups();
+	const auto MaterialSlotNames = MeshAttributes.GetPolygonGroupMaterialSlotNames();
 	size_t MaterialIndex = 0;
-	for (const auto& PolygonGroupId : PolygonGroups.GetElementIDs())
+	for (const auto& PolygonGroupId : MeshDescription.PolygonGroups().GetElementIDs())
 	{
-		const FName MaterialName = MeshAttributes.GetPolygonGroupMaterialSlotNames()[PolygonGroupId];
+		const FName MaterialName = MaterialSlotNames[PolygonGroupId];
 		UMaterialInstanceDynamic* Material = CacheMaterial(OpaqueParent, MaskedParent, TranslucentParent, TextureCache, MaterialCache,
 														   Materials[MaterialIndex], MaterialName, StaticMesh);
 
 		if (MaterialSlots.Contains(Material))
 		{
-			MeshAttributes.GetPolygonGroupMaterialSlotNames()[PolygonGroupId] = MaterialSlots[Material];
+			MaterialSlotNames[PolygonGroupId] = MaterialSlots[Material];
 		}
 		else
 		{
 			const FName SlotName = StaticMesh->AddMaterial(Material);
-			MeshAttributes.GetPolygonGroupMaterialSlotNames()[PolygonGroupId] = SlotName;
+			MaterialSlotNames[PolygonGroupId] = SlotName;
 			MaterialSlots.Add(Material, SlotName);
 		}
 
 		++MaterialIndex;
+	}
+
+	// The mesh description and the static mesh materials are not modified anymore until the build has been finished
+	RenderDataBuild = Async(EAsyncExecution::ThreadPool, [this]() { BuildRenderData(); });
+}
 
+void FVitruvioMesh::BuildRenderData()
+{
+	// Vertex buffers, index buffers, sections and bounds are computed the same way as in UStaticMesh::BuildFromMeshDescriptions
+	RenderData = MakeUnique<FStaticMeshRenderData>();
+	RenderData->AllocateLODResources(1);
+	StaticMesh->BuildFromMeshDescription(MeshDescription, RenderData->LODResources[0]);
+	RenderData->Bounds = Stats.NumVertices > 0 ? Stats.Bounds : MeshDescription.GetBounds();
+	RenderData->ScreenSize[0].Default = 1.0f;
+
+#if WITH_EDITORONLY_DATA
+	SourceMeshDescription = MeshDescription;
+#endif
+
+	// Vertex ids are consecutive since the mesh description is created by Vitruvio and vertices are never removed
+	FStaticMeshAttributes MeshAttributes(MeshDescription);
+	const auto VertexPositions = MeshAttributes.GetVertexPositions();
+	TArray<FVector> Vertices(VertexPositions.GetRawArray().GetData(), VertexPositions.GetNumElements());
+
+	TArray<FTriIndices> Indices = MoveTemp(TriangleIndices);
+	if (Indices.Num() == 0)
+	{
 		// cache collision data
-		for (FPolygonID PolygonID : MeshDescription.GetPolygonGroupPolygons(PolygonGroupId))
+		for (const FTriangleID TriangleID : MeshDescription.Triangles().GetElementIDs())
 		{
-			for (FTriangleID TriangleID : MeshDescription.GetPolygonTriangleIDs(PolygonID))
-			{
-				auto TriangleVertexInstances = MeshDescription.GetTriangleVertexInstances(TriangleID);
-
-				auto VertexID0 = MeshDescription.GetVertexInstanceVertex(TriangleVertexInstances[0]);
-				auto VertexID1 = MeshDescription.GetVertexInstanceVertex(TriangleVertexInstances[1]);
-				auto VertexID2 = MeshDescription.GetVertexInstanceVertex(TriangleVertexInstances[2]);
-
-				FTriIndices TriIndex;
-				TriIndex.v0 = VertexID0.GetValue();
-				TriIndex.v1 = VertexID1.GetValue();
-				TriIndex.v2 = VertexID2.GetValue();
-				Indices.Add(TriIndex);
-			}
+			auto TriangleVertexInstances = MeshDescription.GetTriangleVertexInstances(TriangleID);
+
+			FTriIndices TriIndex;
+			TriIndex.v0 = MeshDescription.GetVertexInstanceVertex(TriangleVertexInstances[0]).GetValue();
+			TriIndex.v1 = MeshDescription.GetVertexInstanceVertex(TriangleVertexInstances[1]).GetValue();
+			TriIndex.v2 = MeshDescription.GetVertexInstanceVertex(TriangleVertexInstances[2]).GetValue();
+			Indices.Add(TriIndex);
 		}
 	}
 
-	TArray<const FMeshDescription*> MeshDescriptionPtrs;
-	MeshDescriptionPtrs.Emplace(&MeshDescription);
+	CollisionData = MakeShared<FCollisionData>(FCollisionData {MoveTemp(Indices), MoveTemp(Vertices)});
+}
+
+bool FVitruvioMesh::TryFinishBuild(bool bWait)
+{
+	check(IsInGameThread());
+
+	if (bIsBuilt)
+	{
+		return true;
+	}
+
+	if (!RenderDataBuild.IsValid() || (!bWait && !RenderDataBuild.IsReady()))
+	{
+		return false;
+	}
+
+	RenderDataBuild.Wait();
+	RenderDataBuild.Reset();
 
-	StaticMesh->BuildFromMeshDescriptions(MeshDescriptionPtrs);
-	CollisionData = {Indices, Vertices};
+	StaticMesh->SetRenderData(MoveTemp(RenderData));
+	StaticMesh->InitResources();
+	StaticMesh->CalculateExtendedBounds();
+
+#if WITH_EDITORONLY_DATA
+	// The render data is not built from a source model, create it so that GetMeshDescription works as for meshes built from mesh descriptions
+	StaticMesh->SetNumSourceModels(1);
+	StaticMesh->CreateMeshDescription(0, MoveTemp(SourceMeshDescription));
+#endif
+
+	// The physics meshes are only cooked once a component requests the collision (see GetBodySetup)
+	UGeneratedModelCollision* Collision = NewObject<UGeneratedModelCollision>(StaticMesh, NAME_None, RF_Transient);
+	Collision->SetCollisionData(CollisionData);
+	StaticMesh->AddAssetUserData(Collision);
+
+	bIsBuilt = true;
+	return true;
+}
+
+UBodySetup* FVitruvioMesh::GetBodySetup(bool bComplexCollision) const
+{
+	UGeneratedModelCollision* Collision = bIsBuilt ? StaticMesh->GetAssetUserData<UGeneratedModelCollision>() : nullptr;
+	return Collision ? Collision->GetBodySetup(bComplexCollision) : nullptr;
+}
+
+void FVitruvioMesh::Build(const FString& Name, TMap<Vitruvio::FMaterialAttributeContainer, UMaterialInstanceDynamic*>& MaterialCache,
+						  TMap<FString, Vitruvio::FTextureData>& TextureCache, UMaterial* OpaqueParent, UMaterial* MaskedParent,
+						  UMaterial* TranslucentParent)
+{
+	BeginBuild(Name, MaterialCache, TextureCache, OpaqueParent, MaskedParent, TranslucentParent);
+	TryFinishBuild(true);
 }
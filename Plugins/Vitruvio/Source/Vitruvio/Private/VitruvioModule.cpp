@@ -16,9 +16,13 @@
 #include "VitruvioModule.h"
 
 #include "AsyncHelpers.h"
+#include "LegacyUnrealCallbacks.h"
 #include "PRTTypes.h"
 #include "PRTUtils.h"
 #include "UnrealCallbacks.h"
+#include "VitruvioComponent.h"
+
+#include "Codec/Adaptor/RulePackageRegistry.h"
 
 #include "Util/AttributeConversion.h"
 #include "Util/MaterialConversion.h"
@@ -27,6 +31,7 @@
 #include "prt/API.h"
 #include "prtx/EncoderInfoBuilder.h"
 
+#include "Async/Async.h"
 #include "Core.h"
 #include "IImageWrapper.h"
 #include "Interfaces/IPluginManager.h"
@@ -35,28 +40,66 @@
 #include "StaticMeshAttributes.h"
 #include "TextureDecoding.h"
 #include "UObject/UObjectBaseUtility.h"
+#include "UObject/UObjectIterator.h"
 
 #define LOCTEXT_NAMESPACE "VitruvioModule"
 
 DEFINE_LOG_CATEGORY(LogUnrealPrt);
 
+DEFINE_STAT(STAT_VitruvioCanceledGenerateCalls);
+DEFINE_STAT(STAT_VitruvioGenerateResultCacheHits);
+DEFINE_STAT(STAT_VitruvioGenerateResultCacheMisses);
+DEFINE_STAT(STAT_VitruvioGenerateResultCacheMemory);
+DEFINE_STAT(STAT_VitruvioGenerateResultDiskCacheHits);
+DEFINE_STAT(STAT_VitruvioGenerateResultDiskCacheMisses);
+
 namespace
 {
 constexpr const wchar_t* ATTRIBUTE_EVAL_ENCODER_ID = L"com.esri.prt.core.AttributeEvalEncoder";
 
+constexpr const TCHAR* VITRUVIO_CONFIG_SECTION = TEXT("Vitruvio");
+
+constexpr int32 DEFAULT_GENERATE_RESULT_DISK_CACHE_SIZE_MB = 2048;
+
+// Unpack folders of rule packages which have not been loaded for this many days are deleted on startup
+constexpr int32 DEFAULT_RULE_PACKAGE_UNPACK_FOLDER_MAX_AGE_DAYS = 30;
+
+// File in each rule package unpack folder whose modification time is the last time the rule package has been loaded
+constexpr const TCHAR* RULE_PACKAGE_LAST_USED_FILE = TEXT("LastUsed");
+
+// Copy of the rpk in its unpack folder, only written if the encoder library cannot serve rule packages from memory
+constexpr const TCHAR* RULE_PACKAGE_FILE = TEXT("RulePackage.rpk");
+
+// Resolved from the encoder library in InitializePrt before any rule package is loaded. Not exported by libraries which predate loading
+// rule packages from memory.
+RegisterRulePackageFunc RegisterRulePackage = nullptr;
+UnregisterRulePackageFunc UnregisterRulePackage = nullptr;
+
+// Set in InitializePrt if the encoder library implements the unversioned IUnrealCallbacks layout (see FLegacyUnrealCallbacks)
+bool bLegacyEncoderCallbacks = false;
+
 class FLoadResolveMapTask
 {
 	TLazyObjectPtr<URulePackage> LazyRulePackagePtr;
-	TPromise<ResolveMapSPtr> Promise;
-	TMap<TLazyObjectPtr<URulePackage>, ResolveMapSPtr>& ResolveMapCache;
+	TPromise<FRulePackageInfoPtr> Promise;
+	TMap<TLazyObjectPtr<URulePackage>, FRulePackageInfoPtr>& ResolveMapCache;
+	TMap<TLazyObjectPtr<URulePackage>, FMD5Hash>& ResolveMapHashes;
+	FGenerateResultCache& GenerateResultCache;
 	FCriticalSection& LoadResolveMapLock;
-	FString RpkFolder;
+	FThreadSafeCounter& RpkLoadingQueueCounter;
+	FThreadSafeCounter& RpkLoadingTasksCounter;
+	FString RpkUnpackFolder;
+	prt::Cache* PrtCache;
 
 public:
-	FLoadResolveMapTask(TPromise<ResolveMapSPtr>&& InPromise, const FString RpkFolder, const TLazyObjectPtr<URulePackage> LazyRulePackagePtr,
-						TMap<TLazyObjectPtr<URulePackage>, ResolveMapSPtr>& ResolveMapCache, FCriticalSection& LoadResolveMapLock)
-		: LazyRulePackagePtr(LazyRulePackagePtr), Promise(MoveTemp(InPromise)), ResolveMapCache(ResolveMapCache),
-		  LoadResolveMapLock(LoadResolveMapLock), RpkFolder(RpkFolder)
+	FLoadResolveMapTask(TPromise<FRulePackageInfoPtr>&& InPromise, const FString RpkUnpackFolder, prt::Cache* PrtCache,
+						const TLazyObjectPtr<URulePackage> LazyRulePackagePtr,
+						TMap<TLazyObjectPtr<URulePackage>, FRulePackageInfoPtr>& ResolveMapCache,
+						TMap<TLazyObjectPtr<URulePackage>, FMD5Hash>& ResolveMapHashes, FGenerateResultCache& GenerateResultCache,
+						FCriticalSection& LoadResolveMapLock, FThreadSafeCounter& RpkLoadingQueueCounter, FThreadSafeCounter& RpkLoadingTasksCounter)
+		: LazyRulePackagePtr(LazyRulePackagePtr), Promise(MoveTemp(InPromise)), ResolveMapCache(ResolveMapCache), ResolveMapHashes(ResolveMapHashes),
+		  GenerateResultCache(GenerateResultCache), LoadResolveMapLock(LoadResolveMapLock), RpkLoadingQueueCounter(RpkLoadingQueueCounter),
+		  RpkLoadingTasksCounter(RpkLoadingTasksCounter), RpkUnpackFolder(RpkUnpackFolder), PrtCache(PrtCache)
 	{
 	}
 
@@ -81,42 +124,112 @@ public:
 
 	void DoTask(ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent)
 	{
-		const FString UriPath = LazyRulePackagePtr->GetPathName();
+		RpkLoadingTasksCounter.Increment();
+		RpkLoadingQueueCounter.Decrement();
 
-		// Create rpk on disk for PRT
+		// Assets are unpacked to a folder which only depends on the rpk content and is therefore reused across sessions
+		const FMD5Hash RulePackageHash = GenerateResultCache.GetRulePackageHash(LazyRulePackagePtr.Get());
+		const FString UnpackPath = FPaths::ConvertRelativePathToFull(FPaths::Combine(RpkUnpackFolder, LexToString(RulePackageHash)));
 		IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+		PlatformFile.CreateDirectoryTree(*UnpackPath);
+		FFileHelper::SaveStringToFile(FString(), *FPaths::Combine(UnpackPath, RULE_PACKAGE_LAST_USED_FILE));
 
-		const FString RpkFile = FPaths::GetBaseFilename(UriPath, false) + TEXT(".rpk");
-		const FString RpkFilePath = FPaths::Combine(RpkFolder, RpkFile);
-		const FString RpkFolderPath = FPaths::GetPath(RpkFilePath);
+		const ResolveMapSPtr ResolveMapPtr = RegisterRulePackage ? CreateResolveMapFromMemory(UnpackPath) : CreateResolveMapFromFile(UnpackPath);
 
-		IFileManager::Get().Delete(*RpkFilePath);
-		PlatformFile.CreateDirectoryTree(*RpkFolderPath);
+		const FRulePackageInfoPtr RulePackageInfo = ResolveMapPtr ? CreateRulePackageInfo(ResolveMapPtr) : FRulePackageInfoPtr();
+		{
+			FScopeLock Lock(&LoadResolveMapLock);
+			ResolveMapCache.Add(LazyRulePackagePtr, RulePackageInfo);
+			ResolveMapHashes.Add(LazyRulePackagePtr, RulePackageHash);
+			Promise.SetValue(RulePackageInfo);
+		}
+	}
 
-		IFileHandle* RpkHandle = PlatformFile.OpenWrite(*RpkFilePath);
-		if (RpkHandle)
+private:
+	// Serves the rpk to PRT directly from memory instead of writing it to a file first
+	ResolveMapSPtr CreateResolveMapFromMemory(const FString& UnpackPath) const
+	{
+		const TArray<uint8>& RulePackageData = LazyRulePackagePtr->Data;
+		const uint64_t RulePackageId = RegisterRulePackage(RulePackageData.GetData(), RulePackageData.Num());
+		const std::wstring RpkUri = std::wstring(RULE_PACKAGE_URI_SCHEME) + L":/" + std::to_wstring(RulePackageId) + L".rpk";
+		const std::wstring UnpackFileSystemPath(TCHAR_TO_WCHAR(*UnpackPath));
+
+		prt::Status Status;
+		const prt::ResolveMap* ResolveMap = prt::createResolveMap(RpkUri.c_str(), UnpackFileSystemPath.c_str(), &Status);
+		if (!ResolveMap)
 		{
-			// Write file to disk
-			RpkHandle->Write(LazyRulePackagePtr->Data.GetData(), LazyRulePackagePtr->Data.Num());
-			RpkHandle->Flush();
-			delete RpkHandle;
+			UE_LOG(LogUnrealPrt, Error, TEXT("Failed to load rule package %s: %hs"), *LazyRulePackagePtr->GetPathName(),
+				   prt::getStatusDescription(Status))
+			UnregisterRulePackage(RulePackageId);
+			return {};
+		}
 
-			// Create rpk
-			const std::wstring AbsoluteRpkPath(TCHAR_TO_WCHAR(*FPaths::ConvertRelativePathToFull(RpkFilePath)));
+		// The resolve map accesses the registered data lazily, so it is released together with the resolve map
+		return ResolveMapSPtr(ResolveMap, [RulePackageId](const prt::ResolveMap* LoadedResolveMap) {
+			LoadedResolveMap->destroy();
+			UnregisterRulePackage(RulePackageId);
+		});
+	}
 
-			const std::wstring RpkFileUri = prtu::toFileURI(AbsoluteRpkPath);
-			prt::Status Status;
-			const ResolveMapSPtr ResolveMapPtr(prt::createResolveMap(RpkFileUri.c_str(), nullptr, &Status), PRTDestroyer());
+	// Writes the rpk into its unpack folder once and loads it from there, used with encoder libraries which cannot serve rule packages from
+	// memory
+	ResolveMapSPtr CreateResolveMapFromFile(const FString& UnpackPath) const
+	{
+		const FString RpkFilePath = FPaths::Combine(UnpackPath, RULE_PACKAGE_FILE);
+		IFileManager& FileManager = IFileManager::Get();
+		if (FileManager.FileSize(*RpkFilePath) != LazyRulePackagePtr->Data.Num())
+		{
+			// Written to a temporary file first so that a concurrent load of the same rpk never reads a partially written file
+			const FString TempRpkFilePath = FPaths::CreateTempFilename(*UnpackPath, TEXT("RulePackage"), TEXT(".tmp"));
+			if (!FFileHelper::SaveArrayToFile(LazyRulePackagePtr->Data, *TempRpkFilePath) || !FileManager.Move(*RpkFilePath, *TempRpkFilePath, false))
 			{
-				FScopeLock Lock(&LoadResolveMapLock);
-				ResolveMapCache.Add(LazyRulePackagePtr, ResolveMapPtr);
-				Promise.SetValue(ResolveMapPtr);
+				FileManager.Delete(*TempRpkFilePath);
 			}
 		}
-		else
+
+		const std::wstring AbsoluteRpkPath(TCHAR_TO_WCHAR(*RpkFilePath));
+		const std::wstring RpkFileUri = prtu::toFileURI(AbsoluteRpkPath);
+		const std::wstring UnpackFileSystemPath(TCHAR_TO_WCHAR(*UnpackPath));
+
+		prt::Status Status;
+		const prt::ResolveMap* ResolveMap = prt::createResolveMap(RpkFileUri.c_str(), UnpackFileSystemPath.c_str(), &Status);
+		if (!ResolveMap)
+		{
+			UE_LOG(LogUnrealPrt, Error, TEXT("Failed to load rule package %s: %hs"), *LazyRulePackagePtr->GetPathName(),
+				   prt::getStatusDescription(Status))
+			return {};
+		}
+
+		return ResolveMapSPtr(ResolveMap, PRTDestroyer());
+	}
+
+	FRulePackageInfoPtr CreateRulePackageInfo(const ResolveMapSPtr& ResolveMapPtr) const
+	{
+		// The rule file, start rule and rule file info are the same for every generate call with this rule package
+		TSharedPtr<FRulePackageInfo, ESPMode::ThreadSafe> RulePackageInfo = MakeShared<FRulePackageInfo, ESPMode::ThreadSafe>();
+		RulePackageInfo->ResolveMap = ResolveMapPtr;
+		RulePackageInfo->RuleFile = prtu::getRuleFileEntry(ResolveMapPtr);
+
+		const wchar_t* RuleFileUri = ResolveMapPtr->getString(RulePackageInfo->RuleFile.c_str());
+		if (!RuleFileUri)
+		{
+			UE_LOG(LogUnrealPrt, Error, TEXT("Rule package %s does not contain a rule file"), *LazyRulePackagePtr->GetPathName())
+			return {};
+		}
+		RulePackageInfo->RuleFileUri = RuleFileUri;
+
+		prt::Status InfoStatus;
+		RuleFileInfoUPtr RuleFileInfo(prt::createRuleFileInfo(RuleFileUri, PrtCache, &InfoStatus));
+		if (!RuleFileInfo || InfoStatus != prt::STATUS_OK)
 		{
-			Promise.SetValue(nullptr);
+			UE_LOG(LogUnrealPrt, Error, TEXT("could not get rule file info from rule file %s"), RuleFileUri)
+			return {};
 		}
+
+		RulePackageInfo->StartRule = prtu::detectStartRule(RuleFileInfo);
+		RulePackageInfo->RuleFileInfo = RuleFileInfoPtr(RuleFileInfo.release(), PRTDestroyer());
+
+		return RulePackageInfo;
 	}
 };
 
@@ -151,10 +264,12 @@ void SetInitialShapeGeometry(const InitialShapeBuilderUPtr& InitialShapeBuilder,
 }
 
 AttributeMapUPtr EvaluateRuleAttribtues(const std::wstring& RuleFile, const std::wstring& StartRule, AttributeMapUPtr Attributes, const ResolveMapSPtr& ResolveMapPtr,
-										   const TArray<FInitialShapeFace>& InitialShape, prt::Cache* Cache, const int32 RandomSeed)
+										   const TArray<FInitialShapeFace>& InitialShape, prt::Cache* Cache, const int32 RandomSeed,
+										   const FInvalidationToken* InvalidationToken)
 {
-	AttributeMapBuilderUPtr UnrealCallbacksAttributeBuilder(prt::AttributeMapBuilder::create());
-	UnrealCallbacks UnrealCallbacks(UnrealCallbacksAttributeBuilder);
+	AttributeMapBuilderVector UnrealCallbacksAttributeBuilders;
+	UnrealCallbacksAttributeBuilders.emplace_back(prt::AttributeMapBuilder::create());
+	UnrealCallbacks UnrealCallbacks(UnrealCallbacksAttributeBuilders, {InvalidationToken});
 
 	InitialShapeBuilderUPtr InitialShapeBuilder(prt::InitialShapeBuilder::create());
 
@@ -172,15 +287,39 @@ AttributeMapUPtr EvaluateRuleAttribtues(const std::wstring& RuleFile, const std:
 	prt::generate(InitialShapes.data(), InitialShapes.size(), nullptr, EncoderIds.data(), EncoderIds.size(), EncoderOptions.data(), &UnrealCallbacks,
 				  Cache, nullptr);
 
-	return AttributeMapUPtr(UnrealCallbacksAttributeBuilder->createAttributeMap());
+	return AttributeMapUPtr(UnrealCallbacksAttributeBuilders[0]->createAttributeMap());
 }
 
-void CleanupTempRpkFolder()
+int32 GetNumWorkerThreads()
 {
-	FString TempDir(WCHAR_TO_TCHAR(prtu::temp_directory_path().c_str()));
-	const FString RpkUnpackFolder = FPaths::Combine(TempDir, TEXT("PRT"), TEXT("UnrealGeometryEncoder"));
-	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
-	PlatformFile.DeleteDirectoryRecursively(*RpkUnpackFolder);
+	int32 NumWorkerThreads = 0;
+	if (GConfig && GConfig->GetInt(VITRUVIO_CONFIG_SECTION, TEXT("NumWorkerThreads"), NumWorkerThreads, GEngineIni) && NumWorkerThreads > 0)
+	{
+		return NumWorkerThreads;
+	}
+
+	// Leave one core for the game thread
+	return FMath::Max(FPlatformMisc::NumberOfCores() - 1, 1);
+}
+
+int32 GetNumTextureWorkerThreads()
+{
+	int32 NumTextureWorkerThreads = 0;
+	if (GConfig && GConfig->GetInt(VITRUVIO_CONFIG_SECTION, TEXT("NumTextureWorkerThreads"), NumTextureWorkerThreads, GEngineIni) &&
+		NumTextureWorkerThreads > 0)
+	{
+		return NumTextureWorkerThreads;
+	}
+
+	// Texture decoding is mostly IO bound and should not compete with the generate calls for all cores
+	return FMath::Clamp(FPlatformMisc::NumberOfCores() / 4, 1, 4);
+}
+
+FString GetGenerateResultCacheVersion()
+{
+	const prt::Version* PrtVersion = prt::getVersion();
+	const FString PluginVersion = IPluginManager::Get().FindPlugin("Vitruvio")->GetDescriptor().VersionName;
+	return FString::Printf(TEXT("%s_%hs"), *PluginVersion, PrtVersion ? PrtVersion->mFullName : "");
 }
 
 FString GetPlatformName()
@@ -209,6 +348,37 @@ FString GetEncoderExtensionPath()
 	return BinariesPath;
 }
 
+FString GetEncoderDllPath()
+{
+	return FPaths::Combine(*GetEncoderExtensionPath(), TEXT("UnrealGeometryEncoder.dll"));
+}
+
+void PruneRulePackageUnpackFolders(const FString& RpkUnpackFolder, int32 MaxAgeDays)
+{
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+
+	TArray<FString> UnpackFolders;
+	PlatformFile.IterateDirectory(*RpkUnpackFolder, [&UnpackFolders](const TCHAR* Path, bool bIsDirectory) {
+		if (bIsDirectory)
+		{
+			UnpackFolders.Add(Path);
+		}
+		return true;
+	});
+
+	const FDateTime MinLastUsed = FDateTime::UtcNow() - FTimespan::FromDays(MaxAgeDays);
+	for (const FString& UnpackFolder : UnpackFolders)
+	{
+		// Folders without last used file have been created by an older version of the plugin
+		const FDateTime LastUsed = PlatformFile.GetTimeStamp(*FPaths::Combine(UnpackFolder, RULE_PACKAGE_LAST_USED_FILE));
+		if (LastUsed == FDateTime::MinValue() || LastUsed < MinLastUsed)
+		{
+			UE_LOG(LogUnrealPrt, Log, TEXT("Deleting unused rule package folder %s"), *UnpackFolder)
+			PlatformFile.DeleteDirectoryRecursively(*UnpackFolder);
+		}
+	}
+}
+
 FString GetPrtLibDir()
 {
 	const FString BaseDir = GetPrtThirdPartyPath();
@@ -241,6 +411,50 @@ void VitruvioModule::InitializePrt()
 	FPlatformProcess::AddDllDirectory(*PrtLibDir);
 	PrtDllHandle = FPlatformProcess::GetDllHandle(*PrtLibPath);
 
+	// The encoder library is loaded by PRT as an extension as well. Its Vitruvio specific exports are resolved here so that an outdated
+	// library (which has not been rebuilt from Extras/UnrealGeometryEncoder) is detected instead of failing at the first call.
+	const FString EncoderDllPath = GetEncoderDllPath();
+	EncoderDllHandle = FPlatformProcess::GetDllHandle(*EncoderDllPath);
+	if (EncoderDllHandle)
+	{
+		RegisterRulePackage = static_cast<RegisterRulePackageFunc>(FPlatformProcess::GetDllExport(EncoderDllHandle, TEXT("registerRulePackage")));
+		UnregisterRulePackage =
+			static_cast<UnregisterRulePackageFunc>(FPlatformProcess::GetDllExport(EncoderDllHandle, TEXT("unregisterRulePackage")));
+	}
+	if (!RegisterRulePackage || !UnregisterRulePackage)
+	{
+		RegisterRulePackage = nullptr;
+		UnregisterRulePackage = nullptr;
+		UE_LOG(LogUnrealPrt, Warning,
+			   TEXT("%s does not export registerRulePackage/unregisterRulePackage, rule packages are loaded from files instead. Rebuild the "
+					"UnrealGeometryEncoder from Extras/UnrealGeometryEncoder to load them from memory."),
+			   *EncoderDllPath)
+	}
+
+	// The encoder calls into UnrealCallbacks through its vtable, a library built against another interface version would call the wrong
+	// functions. Libraries which predate versioning are still supported through FLegacyUnrealCallbacks.
+	const GetUnrealCallbacksVersionFunc GetUnrealCallbacksVersion =
+		EncoderDllHandle
+			? static_cast<GetUnrealCallbacksVersionFunc>(FPlatformProcess::GetDllExport(EncoderDllHandle, TEXT("getUnrealCallbacksVersion")))
+			: nullptr;
+	const uint32 EncoderCallbacksVersion = GetUnrealCallbacksVersion ? GetUnrealCallbacksVersion() : 1;
+	bLegacyEncoderCallbacks = EncoderCallbacksVersion == 1;
+	if (bLegacyEncoderCallbacks)
+	{
+		UE_LOG(LogUnrealPrt, Warning,
+			   TEXT("%s was built against the unversioned IUnrealCallbacks, initial shapes are generated one at a time. Rebuild the "
+					"UnrealGeometryEncoder from Extras/UnrealGeometryEncoder to generate them in batches."),
+			   *EncoderDllPath)
+	}
+	else if (EncoderCallbacksVersion != UNREAL_CALLBACKS_VERSION)
+	{
+		UE_LOG(LogUnrealPrt, Error,
+			   TEXT("%s was built against IUnrealCallbacks version %u but Vitruvio requires version %u. Rebuild the UnrealGeometryEncoder from "
+					"Extras/UnrealGeometryEncoder. Vitruvio will not be initialized."),
+			   *EncoderDllPath, EncoderCallbacksVersion, UNREAL_CALLBACKS_VERSION)
+		return;
+	}
+
 	TArray<wchar_t*> PRTPluginsPaths;
 	const FString EncoderExtensionPath = GetEncoderExtensionPath();
 	const FString PrtExtensionPaths = GetPrtLibDir();
@@ -256,8 +470,52 @@ void VitruvioModule::InitializePrt()
 
 	PrtCache.reset(prt::CacheObject::create(prt::CacheObject::CACHE_TYPE_NONREDUNDANT));
 
-	const FString TempDir(WCHAR_TO_TCHAR(prtu::temp_directory_path().c_str()));
-	RpkFolder = FPaths::CreateTempFilename(*TempDir, TEXT("Vitruvio_"), TEXT(""));
+	RpkUnpackFolder = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Vitruvio"), TEXT("RulePackages"));
+
+	// Pruned before any rule package is loaded, since loading a rule package might reuse a folder
+	int32 UnpackFolderMaxAgeDays = DEFAULT_RULE_PACKAGE_UNPACK_FOLDER_MAX_AGE_DAYS;
+	if (GConfig)
+	{
+		GConfig->GetInt(VITRUVIO_CONFIG_SECTION, TEXT("RulePackageUnpackFolderMaxAgeDays"), UnpackFolderMaxAgeDays, GEngineIni);
+	}
+	if (UnpackFolderMaxAgeDays > 0)
+	{
+		PruneRulePackageUnpackFolders(RpkUnpackFolder, UnpackFolderMaxAgeDays);
+	}
+
+	// Generate calls are scheduled on a bounded pool instead of spawning a new thread per call. A stack size of 0 selects the platform default
+	// thread stack size, the default stack size of the pool (32 KB) is too small for PRT.
+	const int32 NumWorkerThreads = GetNumWorkerThreads();
+	ThreadPool.Reset(FQueuedThreadPool::Allocate());
+	verify(ThreadPool->Create(NumWorkerThreads, 0, TPri_Normal, TEXT("VitruvioThreadPool")));
+
+	UE_LOG(LogUnrealPrt, Display, TEXT("Created Vitruvio thread pool with %d worker threads"), NumWorkerThreads)
+
+	// Textures referenced by generated materials are decoded on a separate pool so that they neither delay generate calls nor block the game
+	// thread once the materials are created.
+	const int32 NumTextureWorkerThreads = GetNumTextureWorkerThreads();
+	TextureThreadPool.Reset(FQueuedThreadPool::Allocate());
+	verify(TextureThreadPool->Create(NumTextureWorkerThreads, 0, TPri_Normal, TEXT("VitruvioTextureThreadPool")));
+
+	int32 GenerateResultCacheSizeMB = 0;
+	if (GConfig && GConfig->GetInt(VITRUVIO_CONFIG_SECTION, TEXT("GenerateResultCacheSizeMB"), GenerateResultCacheSizeMB, GEngineIni))
+	{
+		GenerateResultCache.SetMemoryBudget(static_cast<int64>(FMath::Max(GenerateResultCacheSizeMB, 0)) * 1024 * 1024);
+	}
+
+	bool bEnableDiskCache = true;
+	int32 DiskCacheSizeMB = DEFAULT_GENERATE_RESULT_DISK_CACHE_SIZE_MB;
+	if (GConfig)
+	{
+		GConfig->GetBool(VITRUVIO_CONFIG_SECTION, TEXT("bEnableGenerateResultDiskCache"), bEnableDiskCache, GEngineIni);
+		GConfig->GetInt(VITRUVIO_CONFIG_SECTION, TEXT("GenerateResultDiskCacheSizeMB"), DiskCacheSizeMB, GEngineIni);
+	}
+	if (bEnableDiskCache && Initialized)
+	{
+		const FString DiskCacheDirectory = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Vitruvio"), TEXT("GenerateCache"));
+		GenerateResultDiskCache.Initialize(DiskCacheDirectory, GetGenerateResultCacheVersion(),
+										   static_cast<int64>(FMath::Max(DiskCacheSizeMB, 0)) * 1024 * 1024);
+	}
 }
 
 void VitruvioModule::StartupModule()
@@ -269,10 +527,14 @@ void VitruvioModule::StartupModule()
 	}
 
 	InitializePrt();
+
+	PostLoadMapHandle = FCoreUObjectDelegates::PostLoadMapWithWorld.AddRaw(this, &VitruvioModule::OnPostLoadMapWithWorld);
 }
 
 void VitruvioModule::ShutdownModule()
 {
+	FCoreUObjectDelegates::PostLoadMapWithWorld.Remove(PostLoadMapHandle);
+
 	if (!Initialized)
 	{
 		return;
@@ -281,14 +543,32 @@ void VitruvioModule::ShutdownModule()
 	Initialized = false;
 
 	UE_LOG(LogUnrealPrt, Display,
-		   TEXT("Shutting down Vitruvio. Waiting for ongoing generate calls (%d), RPK loading tasks (%d) and attribute loading tasks (%d)"),
-		   GenerateCallsCounter.GetValue(), RpkLoadingTasksCounter.GetValue(), LoadAttributesCounter.GetValue())
+		   TEXT("Shutting down Vitruvio. Waiting for ongoing generate calls (%d, %d queued), RPK loading tasks (%d, %d queued), attribute "
+				"loading tasks (%d) and texture loading tasks (%d)"),
+		   GenerateCallsCounter.GetValue(), GenerateQueueCounter.GetValue(), RpkLoadingTasksCounter.GetValue(), RpkLoadingQueueCounter.GetValue(),
+		   LoadAttributesCounter.GetValue(), TextureLoadingTasksCounter.GetValue())
 
-	// Wait until no more PRT calls are ongoing
+	// Wait until no more PRT calls are ongoing. Queued calls return immediately since the module is no longer initialized.
 	FGenericPlatformProcess::ConditionalSleep(
-		[this]() { return GenerateCallsCounter.GetValue() == 0 && RpkLoadingTasksCounter.GetValue() == 0 && LoadAttributesCounter.GetValue() == 0; },
+		[this]() {
+			return GenerateCallsCounter.GetValue() == 0 && GenerateQueueCounter.GetValue() == 0 && RpkLoadingTasksCounter.GetValue() == 0 &&
+				   RpkLoadingQueueCounter.GetValue() == 0 && LoadAttributesCounter.GetValue() == 0 && TextureLoadingTasksCounter.GetValue() == 0;
+		},
 		0); // Yield to other threads
 
+	if (ThreadPool)
+	{
+		ThreadPool->Destroy();
+		ThreadPool.Reset();
+	}
+	if (TextureThreadPool)
+	{
+		TextureThreadPool->Destroy();
+		TextureThreadPool.Reset();
+	}
+
+	GenerateResultDiskCache.Flush();
+
 	UE_LOG(LogUnrealPrt, Display, TEXT("PRT calls finished. Shutting down."))
 
 	if (PrtDllHandle)
@@ -300,8 +580,11 @@ void VitruvioModule::ShutdownModule()
 	{
 		PrtLibrary->destroy();
 	}
-
-	CleanupTempRpkFolder();
+	if (EncoderDllHandle)
+	{
+		FPlatformProcess::FreeDllHandle(EncoderDllHandle);
+		EncoderDllHandle = nullptr;
+	}
 
 	UE_LOG(LogUnrealPrt, Display, TEXT("Shutdown complete"))
 }
@@ -320,9 +603,21 @@ Vitruvio::FTextureData VitruvioModule::DecodeTexture(UObject* Outer, const FStri
 }
 
 FGenerateResult VitruvioModule::GenerateAsync(const TArray<FInitialShapeFace>& InitialShape, URulePackage* RulePackage, AttributeMapUPtr Attributes,
-											  const int32 RandomSeed) const
+											  const int32 RandomSeed, EQueuedWorkPriority Priority) const
 {
-	check(RulePackage);
+	return GenerateRequestAsync({InitialShape, RulePackage, std::move(Attributes), RandomSeed}, Priority);
+}
+
+FGenerateResult VitruvioModule::GenerateAndEvaluateRuleAttributesAsync(const TArray<FInitialShapeFace>& InitialShape, URulePackage* RulePackage,
+																	   AttributeMapUPtr Attributes, const int32 RandomSeed,
+																	   EQueuedWorkPriority Priority) const
+{
+	return GenerateRequestAsync({InitialShape, RulePackage, std::move(Attributes), RandomSeed, true}, Priority);
+}
+
+FGenerateResult VitruvioModule::GenerateRequestAsync(FGenerateRequest Request, EQueuedWorkPriority Priority) const
+{
+	check(Request.RulePackage);
 
 	const FGenerateResult::FTokenPtr Token = MakeShared<FGenerateToken>();
 
@@ -338,9 +633,32 @@ FGenerateResult VitruvioModule::GenerateAsync(const TArray<FInitialShapeFace>& I
 		};
 	}
 
-	FGenerateResult::FFutureType ResultFuture = Async(EAsyncExecution::Thread, [=, AttributeMap = std::move(Attributes)]() mutable {
-		FGenerateResultDescription Result = Generate(InitialShape, RulePackage, std::move(AttributeMap), RandomSeed);
-		return FGenerateResult::ResultType{Token, MoveTemp(Result)};
+	GenerateQueueCounter.Increment();
+
+	const TSharedRef<TPromise<FGenerateResult::ResultType>, ESPMode::ThreadSafe> Promise =
+		MakeShared<TPromise<FGenerateResult::ResultType>, ESPMode::ThreadSafe>();
+	FGenerateResult::FFutureType ResultFuture = Promise->GetFuture();
+
+	URulePackage* RulePackage = Request.RulePackage;
+	const TSharedRef<FGenerateRequest, ESPMode::ThreadSafe> SharedRequest = MakeShared<FGenerateRequest, ESPMode::ThreadSafe>(MoveTemp(Request));
+	ExecuteWhenRulePackageLoaded(RulePackage, [this, Token, Promise, SharedRequest, Priority]() {
+		AsyncPool(
+			*ThreadPool,
+			[this, Token, Promise, SharedRequest]() {
+				TArray<FGenerateRequest> Requests;
+				Requests.Add(MoveTemp(*SharedRequest));
+
+				GenerateCallsCounter.Increment();
+				GenerateQueueCounter.Decrement();
+
+				TArray<FGenerateResultDescription> Results = GenerateBatch(Requests, {Token});
+				const TSharedRef<TArray<FGenerateResultDescription>, ESPMode::ThreadSafe> SharedResults =
+					MakeShared<TArray<FGenerateResultDescription>, ESPMode::ThreadSafe>(MoveTemp(Results));
+				ExecuteWhenTexturesLoaded(*SharedResults, [Token, Promise, SharedResults]() {
+					Promise->SetValue(FGenerateResult::ResultType{Token, MoveTemp((*SharedResults)[0])});
+				});
+			},
+			nullptr, Priority);
 	});
 
 	return FGenerateResult{MoveTemp(ResultFuture), Token};
@@ -351,53 +669,334 @@ FGenerateResultDescription VitruvioModule::Generate(const TArray<FInitialShapeFa
 {
 	check(RulePackage);
 
+	TArray<FGenerateRequest> Requests;
+	Requests.Add({InitialShape, RulePackage, std::move(Attributes), RandomSeed});
+
+	GenerateCallsCounter.Increment();
+
+	TArray<FGenerateResultDescription> Results = GenerateBatch(Requests);
+	return MoveTemp(Results[0]);
+}
+
+TArray<FGenerateResult> VitruvioModule::GenerateBatchAsync(TArray<FGenerateRequest> Requests, EQueuedWorkPriority Priority) const
+{
+	using FPromisePtr = TSharedRef<TPromise<FGenerateResult::ResultType>, ESPMode::ThreadSafe>;
+
+	TArray<FGenerateResult> Results;
+	TArray<FPromisePtr> Promises;
+	for (int32 RequestIndex = 0; RequestIndex < Requests.Num(); ++RequestIndex)
+	{
+		check(Requests[RequestIndex].RulePackage);
+
+		FPromisePtr Promise = MakeShared<TPromise<FGenerateResult::ResultType>, ESPMode::ThreadSafe>();
+		Results.Add({Promise->GetFuture(), MakeShared<FGenerateToken>()});
+		Promises.Add(Promise);
+	}
+
 	if (!Initialized)
 	{
 		UE_LOG(LogUnrealPrt, Warning, TEXT("PRT not initialized"))
-		return {};
+
+		for (int32 RequestIndex = 0; RequestIndex < Requests.Num(); ++RequestIndex)
+		{
+			Promises[RequestIndex]->SetValue({Results[RequestIndex].Token, {}});
+		}
+		return Results;
 	}
 
-	GenerateCallsCounter.Increment();
+	// Group the requests by rule package since all initial shapes of a single PRT generate call share the same resolve map
+	TMap<URulePackage*, TArray<int32>> RequestIndicesByRulePackage;
+	for (int32 RequestIndex = 0; RequestIndex < Requests.Num(); ++RequestIndex)
+	{
+		RequestIndicesByRulePackage.FindOrAdd(Requests[RequestIndex].RulePackage).Add(RequestIndex);
+	}
 
-	const InitialShapeBuilderUPtr InitialShapeBuilder(prt::InitialShapeBuilder::create());
-	SetInitialShapeGeometry(InitialShapeBuilder, InitialShape);
+	// Large groups are split into one chunk per worker thread so that the initial shapes of a single rule package are generated in parallel
+	const int32 NumWorkerThreads = FMath::Max(ThreadPool->GetNumThreads(), 1);
+	TArray<TPair<URulePackage*, TArray<int32>>> Chunks;
+	for (const auto& RulePackageAndIndices : RequestIndicesByRulePackage)
+	{
+		const TArray<int32>& Indices = RulePackageAndIndices.Value;
+		const int32 ChunkSize = FMath::DivideAndRoundUp(Indices.Num(), NumWorkerThreads);
+		for (int32 ChunkStart = 0; ChunkStart < Indices.Num(); ChunkStart += ChunkSize)
+		{
+			const int32 ChunkNum = FMath::Min(ChunkSize, Indices.Num() - ChunkStart);
+			Chunks.Emplace(RulePackageAndIndices.Key, TArray<int32>(Indices.GetData() + ChunkStart, ChunkNum));
+		}
+	}
+
+	for (const auto& RulePackageAndIndices : Chunks)
+	{
+		TArray<FGenerateRequest> GroupRequests;
+		TArray<FPromisePtr> GroupPromises;
+		TArray<FGenerateResult::FTokenPtr> GroupTokens;
+		for (const int32 RequestIndex : RulePackageAndIndices.Value)
+		{
+			GroupRequests.Add(MoveTemp(Requests[RequestIndex]));
+			GroupPromises.Add(Promises[RequestIndex]);
+			GroupTokens.Add(Results[RequestIndex].Token);
+		}
+
+		GenerateQueueCounter.Add(GroupRequests.Num());
+
+		const TSharedRef<TArray<FGenerateRequest>, ESPMode::ThreadSafe> SharedGroupRequests =
+			MakeShared<TArray<FGenerateRequest>, ESPMode::ThreadSafe>(MoveTemp(GroupRequests));
+		ExecuteWhenRulePackageLoaded(RulePackageAndIndices.Key, [this, SharedGroupRequests, GroupPromises, GroupTokens, Priority]() {
+			AsyncPool(
+				*ThreadPool,
+				[this, SharedGroupRequests, GroupPromises, GroupTokens]() {
+					TArray<FGenerateRequest>& GroupRequests = *SharedGroupRequests;
+					GenerateCallsCounter.Add(GroupRequests.Num());
+					GenerateQueueCounter.Subtract(GroupRequests.Num());
+
+					const TSharedRef<TArray<FGenerateResultDescription>, ESPMode::ThreadSafe> GroupResults =
+						MakeShared<TArray<FGenerateResultDescription>, ESPMode::ThreadSafe>(GenerateBatch(GroupRequests, GroupTokens));
+					ExecuteWhenTexturesLoaded(*GroupResults, [GroupResults, GroupPromises, GroupTokens]() {
+						for (int32 GroupIndex = 0; GroupIndex < GroupPromises.Num(); ++GroupIndex)
+						{
+							GroupPromises[GroupIndex]->SetValue({GroupTokens[GroupIndex], MoveTemp((*GroupResults)[GroupIndex])});
+						}
+					});
+				},
+				nullptr, Priority);
+		});
+	}
+
+	return Results;
+}
+
+TArray<FGenerateResultDescription> VitruvioModule::GenerateBatch(TArray<FGenerateRequest>& Requests,
+																const TArray<FGenerateResult::FTokenPtr>& Tokens) const
+{
+	TArray<FGenerateResultDescription> Results;
+	Results.SetNum(Requests.Num());
+
+	if (Requests.Num() == 0)
+	{
+		return Results;
+	}
+
+	URulePackage* RulePackage = Requests[0].RulePackage;
+	check(RulePackage);
 
-	const ResolveMapSPtr ResolveMap = LoadResolveMapAsync(RulePackage).Get();
+	if (!Initialized)
+	{
+		UE_LOG(LogUnrealPrt, Warning, TEXT("PRT not initialized"))
+		GenerateCallsCounter.Subtract(Requests.Num());
+		return Results;
+	}
 
-	const std::wstring RuleFile = prtu::getRuleFileEntry(ResolveMap);
-	const wchar_t* RuleFileUri = ResolveMap->getString(RuleFile.c_str());
+	// Evaluated attributes loaded from the disk cache are bound to the rule file info of the loaded rule package
+	const bool bEvaluateAnyAttributes =
+		Requests.ContainsByPredicate([](const FGenerateRequest& Request) { return Request.bEvaluateAttributes; });
+	FRulePackageInfoPtr RulePackageInfo;
+	if (bEvaluateAnyAttributes)
+	{
+		RulePackageInfo = LoadResolveMapAsync(RulePackage).Get();
+	}
 
-	const RuleFileInfoUPtr StartRuleInfo(prt::createRuleFileInfo(RuleFileUri));
-	const std::wstring StartRule = prtu::detectStartRule(StartRuleInfo);
+	// Requests with the same inputs as an already generated result are served from the cache without calling PRT
+	TArray<FGenerateResultCache::FKey> CacheKeys;
+	TArray<int32> GenerateIndices;
+	for (int32 RequestIndex = 0; RequestIndex < Requests.Num(); ++RequestIndex)
+	{
+		const FGenerateRequest& Request = Requests[RequestIndex];
+		check(Request.RulePackage == RulePackage);
 
-	InitialShapeBuilder->setAttributes(RuleFile.c_str(), StartRule.c_str(), RandomSeed, L"", Attributes.get(), ResolveMap.get());
+		const FGenerateResultCache::FKey CacheKey =
+			GenerateResultCache.ComputeKey(RulePackage, Request.InitialShape, Request.Attributes.get(), Request.RandomSeed);
+		CacheKeys.Add(CacheKey);
 
-	AttributeMapBuilderUPtr AttributeMapBuilder(prt::AttributeMapBuilder::create());
-	const TSharedPtr<UnrealCallbacks> OutputHandler(new UnrealCallbacks(AttributeMapBuilder));
+		FGenerateResultCache::FValuePtr CachedResult = GenerateResultCache.Find(CacheKey);
 
-	const InitialShapeUPtr Shape(InitialShapeBuilder->createInitialShapeAndReset());
+		// Cached results can only be used if they also contain the evaluated attributes if requested
+		if (CachedResult && Request.bEvaluateAttributes && !CachedResult->EvaluatedAttributes)
+		{
+			CachedResult.Reset();
+		}
+		if (!CachedResult)
+		{
+			const RuleFileInfoPtr RuleFileInfo = Request.bEvaluateAttributes && RulePackageInfo ? RulePackageInfo->RuleFileInfo : RuleFileInfoPtr();
+			CachedResult = GenerateResultDiskCache.Load(CacheKey, RuleFileInfo);
+			if (CachedResult && Request.bEvaluateAttributes && !CachedResult->EvaluatedAttributes)
+			{
+				CachedResult.Reset();
+			}
+			if (CachedResult)
+			{
+				GenerateResultCache.Add(CacheKey, CachedResult);
+			}
+		}
 
-	const std::vector<const wchar_t*> EncoderIds = {UNREAL_GEOMETRY_ENCODER_ID};
-	const AttributeMapUPtr UnrealEncoderOptions(prtu::createValidatedOptions(UNREAL_GEOMETRY_ENCODER_ID));
-	const AttributeMapNOPtrVector EncoderOptions = {UnrealEncoderOptions.get()};
+		if (CachedResult)
+		{
+			Results[RequestIndex] = *CachedResult;
+			if (!Request.bEvaluateAttributes)
+			{
+				Results[RequestIndex].EvaluatedAttributes.Reset();
+			}
+		}
+		else
+		{
+			GenerateIndices.Add(RequestIndex);
+		}
+	}
 
-	InitialShapeNOPtrVector Shapes = {Shape.get()};
+	if (GenerateIndices.Num() > 0)
+	{
+		if (!bEvaluateAnyAttributes)
+		{
+			RulePackageInfo = LoadResolveMapAsync(RulePackage).Get();
+		}
 
-	const prt::Status GenerateStatus = prt::generate(Shapes.data(), Shapes.size(), nullptr, EncoderIds.data(), EncoderIds.size(),
-													 EncoderOptions.data(), OutputHandler.Get(), PrtCache.get(), nullptr);
+		// Requests with an invalid rule package return empty results
+		if (!RulePackageInfo)
+		{
+			GenerateIndices.Empty();
+		}
+	}
 
-	if (GenerateStatus != prt::STATUS_OK)
+	// The uncached initial shapes are generated in one PRT call for the requests which evaluate attributes and one for the others, so that
+	// only the former pay for the attribute evaluation encoder. Encoder libraries which predate batching can only encode a single initial
+	// shape per call.
+	TArray<TArray<int32>> GenerateBatches;
+	if (bLegacyEncoderCallbacks)
 	{
-		UE_LOG(LogUnrealPrt, Error, TEXT("PRT generate failed: %hs"), prt::getStatusDescription(GenerateStatus))
+		for (const int32 RequestIndex : GenerateIndices)
+		{
+			GenerateBatches.Add({RequestIndex});
+		}
 	}
+	else
+	{
+		TArray<int32> EvaluateAttributesIndices;
+		TArray<int32> GeometryOnlyIndices;
+		for (const int32 RequestIndex : GenerateIndices)
+		{
+			(Requests[RequestIndex].bEvaluateAttributes ? EvaluateAttributesIndices : GeometryOnlyIndices).Add(RequestIndex);
+		}
+
+		if (EvaluateAttributesIndices.Num() > 0)
+		{
+			GenerateBatches.Add(MoveTemp(EvaluateAttributesIndices));
+		}
+		if (GeometryOnlyIndices.Num() > 0)
+		{
+			GenerateBatches.Add(MoveTemp(GeometryOnlyIndices));
+		}
+	}
+
+	for (const TArray<int32>& BatchIndices : GenerateBatches)
+	{
+		const InitialShapeBuilderUPtr InitialShapeBuilder(prt::InitialShapeBuilder::create());
+		std::vector<InitialShapeUPtr> InitialShapes;
+		InitialShapeNOPtrVector Shapes;
+		AttributeMapBuilderVector AttributeMapBuilders;
+		TArray<const FInvalidationToken*> InvalidationTokens;
+		// All requests of a batch either evaluate attributes or not
+		const bool bEvaluateAttributes = Requests[BatchIndices[0]].bEvaluateAttributes;
+		for (const int32 RequestIndex : BatchIndices)
+		{
+			const FGenerateRequest& Request = Requests[RequestIndex];
+
+			SetInitialShapeGeometry(InitialShapeBuilder, Request.InitialShape);
+			InitialShapeBuilder->setAttributes(RulePackageInfo->RuleFile.c_str(), RulePackageInfo->StartRule.c_str(), Request.RandomSeed, L"",
+											   Request.Attributes.get(), RulePackageInfo->ResolveMap.get());
+
+			InitialShapes.emplace_back(InitialShapeBuilder->createInitialShapeAndReset());
+			Shapes.push_back(InitialShapes.back().get());
+			AttributeMapBuilders.emplace_back(prt::AttributeMapBuilder::create());
+			InvalidationTokens.Add(Tokens.IsValidIndex(RequestIndex) ? Tokens[RequestIndex].Get() : nullptr);
+		}
 
-	const int GenerateCalls = GenerateCallsCounter.Decrement();
+		const TSharedPtr<UnrealCallbacks> OutputHandler(new UnrealCallbacks(AttributeMapBuilders, InvalidationTokens));
+		FLegacyUnrealCallbacks LegacyOutputHandler(*OutputHandler);
+		prt::Callbacks* Callbacks = bLegacyEncoderCallbacks ? static_cast<prt::Callbacks*>(&LegacyOutputHandler) : OutputHandler.Get();
+
+		// Attributes are only needed from the attribute evaluation encoder. If they are ever emitted by the geometry encoder they are
+		// forwarded once per initial shape instead of once per leaf shape.
+		const AttributeMapBuilderUPtr UnrealEncoderOptionsBuilder(prt::AttributeMapBuilder::create());
+		UnrealEncoderOptionsBuilder->setBool(L"emitAttributes", false);
+		UnrealEncoderOptionsBuilder->setBool(L"emitAttributesOnce", true);
+		// Let the encoder convert the geometry to Unreal space so that it can be copied directly into the mesh description
+		UnrealEncoderOptionsBuilder->setBool(L"emitUnrealSpaceFloat", true);
+		// Triangulate in PRT so that the triangles can be used as they are for the render and collision meshes
+		UnrealEncoderOptionsBuilder->setBool(L"triangulate", true);
+		// Share one index between positions, normals and uvs so that every vertex only becomes a single vertex instance
+		UnrealEncoderOptionsBuilder->setBool(L"shareVertexIndices", true);
+		// Reports are forwarded with the geometry so that no additional generate is needed to access them
+		UnrealEncoderOptionsBuilder->setBool(L"emitReports", true);
+		const AttributeMapUPtr UnrealEncoderUnvalidatedOptions(UnrealEncoderOptionsBuilder->createAttributeMap());
+
+		// Options which are unknown to an outdated encoder library are dropped by the validation
+		std::vector<const wchar_t*> EncoderIds = {UNREAL_GEOMETRY_ENCODER_ID};
+		const AttributeMapUPtr UnrealEncoderOptions(prtu::createValidatedOptions(UNREAL_GEOMETRY_ENCODER_ID, UnrealEncoderUnvalidatedOptions.get()));
+		AttributeMapNOPtrVector EncoderOptions = {UnrealEncoderOptions.get()};
+
+		// Evaluate the attributes in the same pass as the geometry so that the rules are only executed once
+		AttributeMapUPtr AttributeEncoderOptions;
+		if (bEvaluateAttributes)
+		{
+			AttributeEncoderOptions = prtu::createValidatedOptions(ATTRIBUTE_EVAL_ENCODER_ID);
+			EncoderIds.push_back(ATTRIBUTE_EVAL_ENCODER_ID);
+			EncoderOptions.push_back(AttributeEncoderOptions.get());
+		}
+
+		const prt::Status GenerateStatus = prt::generate(Shapes.data(), Shapes.size(), nullptr, EncoderIds.data(), EncoderIds.size(),
+														 EncoderOptions.data(), Callbacks, PrtCache.get(), nullptr);
+
+		if (GenerateStatus != prt::STATUS_OK && GenerateStatus != prt::STATUS_CANCELED)
+		{
+			UE_LOG(LogUnrealPrt, Error, TEXT("PRT generate failed: %hs"), prt::getStatusDescription(GenerateStatus))
+		}
+
+		int32 NumCanceled = 0;
+		for (int32 ShapeIndex = 0; ShapeIndex < BatchIndices.Num(); ++ShapeIndex)
+		{
+			const int32 RequestIndex = BatchIndices[ShapeIndex];
+			FGenerateResultDescription& GeneratedResult = Results[RequestIndex];
+			GeneratedResult = FGenerateResultDescription{OutputHandler->GetInstances(ShapeIndex), OutputHandler->GetMeshes(ShapeIndex),
+														 OutputHandler->GetNames(ShapeIndex), OutputHandler->GetReports(ShapeIndex)};
+
+			if (Requests[RequestIndex].bEvaluateAttributes)
+			{
+				AttributeMapUPtr EvaluatedAttributes(AttributeMapBuilders[ShapeIndex]->createAttributeMap());
+				GeneratedResult.EvaluatedAttributes = MakeShared<FAttributeMap>(std::move(EvaluatedAttributes), RulePackageInfo->RuleFileInfo);
+			}
+
+			// Canceled results are incomplete and must not be cached
+			if (OutputHandler->isCanceled(ShapeIndex))
+			{
+				NumCanceled++;
+			}
+			else if (GenerateStatus == prt::STATUS_OK)
+			{
+				const FGenerateResultCache::FKey& CacheKey = CacheKeys[RequestIndex];
+				GenerateResultCache.Add(CacheKey, MakeShared<const FGenerateResultDescription, ESPMode::ThreadSafe>(GeneratedResult));
+				GenerateResultDiskCache.Store(CacheKey, GeneratedResult);
+			}
+		}
+		if (NumCanceled > 0)
+		{
+			CanceledGenerateCallsCounter.Add(NumCanceled);
+			INC_DWORD_STAT_BY(STAT_VitruvioCanceledGenerateCalls, NumCanceled);
+		}
+	}
+
+	const int32 GenerateCalls = GenerateCallsCounter.Subtract(Requests.Num()) - Requests.Num();
 
 	if (!Initialized)
 	{
-		return {};
+		return Results;
 	}
 
+	NotifyGenerateCompleted(GenerateCalls);
+
+	return Results;
+}
+
+void VitruvioModule::NotifyGenerateCompleted(int32 GenerateCalls) const
+{
 	// Notify generate complete callback on game thread
 	AsyncTask(ENamedThreads::GameThread, [this, GenerateCalls]() {
 		OnGenerateCompleted.Broadcast(GenerateCalls);
@@ -424,12 +1023,10 @@ FGenerateResultDescription VitruvioModule::Generate(const TArray<FInitialShapeFa
 			OnAllGenerateCompleted.Broadcast(Warnings, Errors);
 		}
 	});
-
-	return FGenerateResultDescription {OutputHandler->GetInstances(), OutputHandler->GetMeshes(), OutputHandler->GetNames() };
 }
 
 FAttributeMapResult VitruvioModule::EvaluateRuleAttributesAsync(const TArray<FInitialShapeFace>& InitialShape, URulePackage* RulePackage,
-															AttributeMapUPtr Attributes, const int32 RandomSeed) const
+															AttributeMapUPtr Attributes, const int32 RandomSeed, EQueuedWorkPriority Priority) const
 {
 	check(RulePackage);
 
@@ -445,38 +1042,36 @@ FAttributeMapResult VitruvioModule::EvaluateRuleAttributesAsync(const TArray<FIn
 
 	LoadAttributesCounter.Increment();
 
-	FAttributeMapResult::FFutureType AttributeMapPtrFuture = Async(EAsyncExecution::Thread, [=, Attributes = std::move(Attributes)]() mutable {
-		const ResolveMapSPtr ResolveMap = LoadResolveMapAsync(RulePackage).Get();
-
-		const std::wstring RuleFile = prtu::getRuleFileEntry(ResolveMap);
-		const wchar_t* RuleFileUri = ResolveMap->getString(RuleFile.c_str());
-
-		const RuleFileInfoUPtr StartRuleInfo(prt::createRuleFileInfo(RuleFileUri));
-		const std::wstring StartRule = prtu::detectStartRule(StartRuleInfo);
+	const TSharedRef<TPromise<FAttributeMapResult::ResultType>, ESPMode::ThreadSafe> Promise =
+		MakeShared<TPromise<FAttributeMapResult::ResultType>, ESPMode::ThreadSafe>();
+	FAttributeMapResult::FFutureType AttributeMapPtrFuture = Promise->GetFuture();
 
-		prt::Status InfoStatus;
-		RuleFileInfoUPtr RuleInfo(prt::createRuleFileInfo(RuleFileUri, PrtCache.get(), &InfoStatus));
-		if (!RuleInfo || InfoStatus != prt::STATUS_OK)
-		{
-			UE_LOG(LogUnrealPrt, Error, TEXT("could not get rule file info from rule file %s"), RuleFileUri)
-			return FAttributeMapResult::ResultType{
-				InvalidationToken,
-				nullptr,
-			};
-		}
+	const TSharedRef<AttributeMapUPtr, ESPMode::ThreadSafe> SharedAttributes = MakeShared<AttributeMapUPtr, ESPMode::ThreadSafe>(std::move(Attributes));
+	ExecuteWhenRulePackageLoaded(RulePackage, [=]() {
+		AsyncPool(*ThreadPool, [=]() {
+			const FRulePackageInfoPtr RulePackageInfo = LoadResolveMapAsync(RulePackage).Get();
+			if (!RulePackageInfo)
+			{
+				LoadAttributesCounter.Decrement();
+				Promise->SetValue(FAttributeMapResult::ResultType{InvalidationToken, nullptr});
+				return;
+			}
 
-		AttributeMapUPtr DefaultAttributeMap(
-			EvaluateRuleAttribtues(RuleFile.c_str(), StartRule.c_str(), std::move(Attributes), ResolveMap, InitialShape, PrtCache.get(), RandomSeed));
+			AttributeMapUPtr DefaultAttributeMap(
+				EvaluateRuleAttribtues(RulePackageInfo->RuleFile, RulePackageInfo->StartRule, std::move(*SharedAttributes), RulePackageInfo->ResolveMap,
+									   InitialShape, PrtCache.get(), RandomSeed, InvalidationToken.Get()));
 
-		LoadAttributesCounter.Decrement();
+			LoadAttributesCounter.Decrement();
 
-		if (!Initialized)
-		{
-			return FAttributeMapResult::ResultType{InvalidationToken, nullptr};
-		}
+			if (!Initialized)
+			{
+				Promise->SetValue(FAttributeMapResult::ResultType{InvalidationToken, nullptr});
+				return;
+			}
 
-		const TSharedPtr<FAttributeMap> AttributeMap = MakeShared<FAttributeMap>(std::move(DefaultAttributeMap), std::move(RuleInfo));
-		return FAttributeMapResult::ResultType{InvalidationToken, AttributeMap};
+			const TSharedPtr<FAttributeMap> AttributeMap = MakeShared<FAttributeMap>(std::move(DefaultAttributeMap), RulePackageInfo->RuleFileInfo);
+			Promise->SetValue(FAttributeMapResult::ResultType{InvalidationToken, AttributeMap});
+		}, nullptr, Priority);
 	});
 
 	return {MoveTemp(AttributeMapPtrFuture), InvalidationToken};
@@ -485,9 +1080,33 @@ FAttributeMapResult VitruvioModule::EvaluateRuleAttributesAsync(const TArray<FIn
 void VitruvioModule::EvictFromResolveMapCache(URulePackage* RulePackage)
 {
 	const TLazyObjectPtr<URulePackage> LazyRulePackagePtr(RulePackage);
+
+	GenerateResultCache.EvictRulePackage(RulePackage);
+	const FMD5Hash RulePackageHash = GenerateResultCache.GetRulePackageHash(RulePackage);
+
 	FScopeLock Lock(&LoadResolveMapLock);
+
+	// Reimporting an unchanged rpk keeps the loaded resolve map and the PRT cache
+	const FMD5Hash* LoadedRulePackageHash = ResolveMapHashes.Find(LazyRulePackagePtr);
+	if (LoadedRulePackageHash && *LoadedRulePackageHash == RulePackageHash)
+	{
+		return;
+	}
+
+	const TOptional<FMD5Hash> EvictedRulePackageHash = LoadedRulePackageHash ? *LoadedRulePackageHash : TOptional<FMD5Hash>();
+
 	ResolveMapCache.Remove(LazyRulePackagePtr);
+	ResolveMapHashes.Remove(LazyRulePackagePtr);
 	PrtCache->flushAll();
+
+	// The unpack folder of the previous content is deleted unless another loaded rule package has the same content
+	TArray<FMD5Hash> LoadedHashes;
+	ResolveMapHashes.GenerateValueArray(LoadedHashes);
+	if (EvictedRulePackageHash && !LoadedHashes.Contains(EvictedRulePackageHash.GetValue()))
+	{
+		const FString UnpackPath = FPaths::Combine(RpkUnpackFolder, LexToString(EvictedRulePackageHash.GetValue()));
+		FPlatformFileManager::Get().GetPlatformFile().DeleteDirectoryRecursively(*UnpackPath);
+	}
 }
 
 void VitruvioModule::RegisterMesh(UStaticMesh* StaticMesh)
@@ -502,10 +1121,152 @@ void VitruvioModule::UnregisterMesh(UStaticMesh* StaticMesh)
 	RegisteredMeshes.Remove(StaticMesh);
 }
 
-TFuture<ResolveMapSPtr> VitruvioModule::LoadResolveMapAsync(URulePackage* const RulePackage) const
+void VitruvioModule::ExecuteWhenRulePackageLoaded(URulePackage* RulePackage, TFunction<void()> Function) const
 {
-	TPromise<ResolveMapSPtr> Promise;
-	TFuture<ResolveMapSPtr> Future = Promise.GetFuture();
+	// Work is only queued on the thread pool once the rule package is available so that workers never block on rule package loading
+	LoadResolveMapAsync(RulePackage).Then([Function = MoveTemp(Function)](TFuture<FRulePackageInfoPtr>) { Function(); });
+}
+
+FGraphEventArray VitruvioModule::LoadTexturesAsync(const TArray<FGenerateResultDescription>& Results) const
+{
+	TMap<FString, FString> TexturesToLoad;
+	auto CollectTextures = [&TexturesToLoad](const TArray<Vitruvio::FMaterialAttributeContainer>& Materials) {
+		for (const Vitruvio::FMaterialAttributeContainer& Material : Materials)
+		{
+			for (const auto& TextureProperty : Material.TextureProperties)
+			{
+				if (!TextureProperty.Value.IsEmpty())
+				{
+					TexturesToLoad.Add(TextureProperty.Value, TextureProperty.Key);
+				}
+			}
+		}
+	};
+
+	for (const FGenerateResultDescription& Result : Results)
+	{
+		for (const auto& IdAndMesh : Result.Meshes)
+		{
+			if (IdAndMesh.Value)
+			{
+				CollectTextures(IdAndMesh.Value->GetMaterials());
+			}
+		}
+		for (const auto& Instance : Result.Instances)
+		{
+			CollectTextures(Instance.Key.MaterialOverrides);
+		}
+	}
+
+	FGraphEventArray TextureEvents;
+	if (TexturesToLoad.Num() == 0 || !Initialized)
+	{
+		return TextureEvents;
+	}
+
+	FScopeLock Lock(&TextureCacheLock);
+	for (const auto& PathAndKey : TexturesToLoad)
+	{
+		const FString& Path = PathAndKey.Key;
+		if (TextureCache.Contains(Path))
+		{
+			continue;
+		}
+
+		if (const FGraphEventRef* LoadEvent = TextureLoadEvents.Find(Path))
+		{
+			TextureEvents.Add(*LoadEvent);
+			continue;
+		}
+
+		FGraphEventRef LoadEvent = FGraphEvent::CreateGraphEvent();
+		TextureLoadEvents.Add(Path, LoadEvent);
+		TextureEvents.Add(LoadEvent);
+
+		TextureLoadingTasksCounter.Increment();
+		AsyncPool(*TextureThreadPool, [this, Path, Key = PathAndKey.Value, LoadEvent]() {
+			if (Initialized)
+			{
+				QUICK_SCOPE_CYCLE_COUNTER(STAT_VitruvioModule_LoadTexture);
+				const Vitruvio::FTextureData TextureData = DecodeTexture(GetTransientPackage(), Path, Key);
+
+				FScopeLock Lock(&TextureCacheLock);
+				TextureCache.Add(Path, TextureData);
+				TextureLoadEvents.Remove(Path);
+			}
+			else
+			{
+				FScopeLock Lock(&TextureCacheLock);
+				TextureLoadEvents.Remove(Path);
+			}
+
+			LoadEvent->DispatchSubsequents();
+			TextureLoadingTasksCounter.Decrement();
+		});
+	}
+
+	return TextureEvents;
+}
+
+void VitruvioModule::ExecuteWhenTexturesLoaded(const TArray<FGenerateResultDescription>& Results, TUniqueFunction<void()> Function) const
+{
+	const FGraphEventArray TextureEvents = LoadTexturesAsync(Results);
+	if (TextureEvents.Num() == 0)
+	{
+		Function();
+		return;
+	}
+
+	FFunctionGraphTask::CreateAndDispatchWhenReady(MoveTemp(Function), TStatId(), &TextureEvents, ENamedThreads::AnyThread);
+}
+
+void VitruvioModule::PrefetchRulePackages(const TArray<URulePackage*>& RulePackages) const
+{
+	if (!Initialized)
+	{
+		return;
+	}
+
+	// Loading tasks of different rule packages run in parallel on the task graph
+	for (URulePackage* RulePackage : RulePackages)
+	{
+		if (RulePackage)
+		{
+			LoadResolveMapAsync(RulePackage);
+		}
+	}
+}
+
+void VitruvioModule::PrefetchRulePackages(UWorld* World) const
+{
+	if (!World)
+	{
+		return;
+	}
+
+	TSet<URulePackage*> RulePackages;
+	for (TObjectIterator<UVitruvioComponent> It; It; ++It)
+	{
+		if (It->GetWorld() == World && It->GetRpk())
+		{
+			RulePackages.Add(It->GetRpk());
+		}
+	}
+
+	UE_LOG(LogUnrealPrt, Log, TEXT("Prefetching %d rule packages of world %s"), RulePackages.Num(), *World->GetName())
+
+	PrefetchRulePackages(RulePackages.Array());
+}
+
+void VitruvioModule::OnPostLoadMapWithWorld(UWorld* World) const
+{
+	PrefetchRulePackages(World);
+}
+
+TFuture<FRulePackageInfoPtr> VitruvioModule::LoadResolveMapAsync(URulePackage* const RulePackage) const
+{
+	TPromise<FRulePackageInfoPtr> Promise;
+	TFuture<FRulePackageInfoPtr> Future = Promise.GetFuture();
 
 	if (!Initialized)
 	{
@@ -537,7 +1298,7 @@ TFuture<ResolveMapSPtr> VitruvioModule::LoadResolveMapAsync(URulePackage* const
 		// Add task which only fetches the result from the cache once the actual loading has finished
 		FGraphEventArray Prerequisites;
 		Prerequisites.Add(*ScheduledTaskEvent);
-		TGraphTask<TAsyncGraphTask<ResolveMapSPtr>>::CreateTask(&Prerequisites)
+		TGraphTask<TAsyncGraphTask<FRulePackageInfoPtr>>::CreateTask(&Prerequisites)
 			.ConstructAndDispatchWhenReady(
 				[this, LazyRulePackagePtr]() {
 					FScopeLock Lock(&LoadResolveMapLock);
@@ -547,14 +1308,15 @@ TFuture<ResolveMapSPtr> VitruvioModule::LoadResolveMapAsync(URulePackage* const
 	}
 	else
 	{
-		RpkLoadingTasksCounter.Increment();
+		RpkLoadingQueueCounter.Increment();
 
 		FGraphEventRef LoadTask;
 		{
 			FScopeLock Lock(&LoadResolveMapLock);
 			// Task which does the actual resolve map loading which might take a long time
-			LoadTask = TGraphTask<FLoadResolveMapTask>::CreateTask().ConstructAndDispatchWhenReady(MoveTemp(Promise), RpkFolder, LazyRulePackagePtr,
-																								   ResolveMapCache, LoadResolveMapLock);
+			LoadTask = TGraphTask<FLoadResolveMapTask>::CreateTask().ConstructAndDispatchWhenReady(
+				MoveTemp(Promise), RpkUnpackFolder, PrtCache.get(), LazyRulePackagePtr, ResolveMapCache, ResolveMapHashes, GenerateResultCache, LoadResolveMapLock,
+				RpkLoadingQueueCounter, RpkLoadingTasksCounter);
 			ResolveMapEventGraphRefCache.Add(LazyRulePackagePtr, LoadTask);
 		}
 
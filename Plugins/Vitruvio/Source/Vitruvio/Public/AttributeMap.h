@@ -25,13 +25,15 @@ class VITRUVIO_API FAttributeMap
 public:
 	FAttributeMap() {}
 
-	FAttributeMap(AttributeMapUPtr AttributeMap, RuleFileInfoUPtr RuleInfo) : AttributeMap(std::move(AttributeMap)), RuleInfo(std::move(RuleInfo)) {}
+	FAttributeMap(AttributeMapUPtr AttributeMap, RuleFileInfoPtr RuleInfo) : AttributeMap(std::move(AttributeMap)), RuleInfo(std::move(RuleInfo)) {}
 
 	TMap<FString, URuleAttribute*> ConvertToUnrealAttributeMap(UObject* const Outer);
 
+	const prt::AttributeMap* GetAttributeMap() const { return AttributeMap.get(); }
+
 private:
 	const AttributeMapUPtr AttributeMap;
-	const RuleFileInfoUPtr RuleInfo;
+	const RuleFileInfoPtr RuleInfo;
 };
 
 using FAttributeMapPtr = TSharedPtr<FAttributeMap>;
@@ -0,0 +1,108 @@
+/* Copyright 2021 Esri
+ *
+ * Licensed under the Apache License Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "InitialShape.h"
+#include "RulePackage.h"
+
+#include "Containers/List.h"
+#include "Misc/SecureHash.h"
+
+#include "prt/AttributeMap.h"
+
+struct FGenerateResultDescription;
+
+/**
+ * LRU cache of generate results keyed by a content hash of the rule package, initial shape geometry, attributes and random seed.
+ */
+class FGenerateResultCache
+{
+public:
+	using FKey = FMD5Hash;
+	using FValuePtr = TSharedPtr<const FGenerateResultDescription, ESPMode::ThreadSafe>;
+
+	FGenerateResultCache();
+	~FGenerateResultCache();
+
+	/**
+	 * \brief Computes the cache key for the given generate inputs. The hash of the rule package data is computed once per rule package.
+	 */
+	VITRUVIO_API FKey ComputeKey(URulePackage* RulePackage, const TArray<FInitialShapeFace>& InitialShape, const prt::AttributeMap* Attributes,
+								 int32 RandomSeed);
+
+	/**
+	 * \return the content hash of the given rule package data. The hash is computed once per rule package.
+	 */
+	VITRUVIO_API FMD5Hash GetRulePackageHash(URulePackage* RulePackage);
+
+	/**
+	 * \return the cached result for the given key or nullptr if the result has not been cached.
+	 */
+	VITRUVIO_API FValuePtr Find(const FKey& Key);
+
+	/**
+	 * \brief Adds the given result to the cache and evicts the least recently used results if the memory budget is exceeded.
+	 */
+	VITRUVIO_API void Add(const FKey& Key, const FValuePtr& Result);
+
+	/**
+	 * \brief Removes the memoized content hash of the given rule package (eg. after it has been reimported).
+	 */
+	VITRUVIO_API void EvictRulePackage(URulePackage* RulePackage);
+
+	VITRUVIO_API void Empty();
+
+	VITRUVIO_API void SetMemoryBudget(int64 InMemoryBudget);
+
+	int32 GetNumHits() const
+	{
+		return Hits.GetValue();
+	}
+
+	int32 GetNumMisses() const
+	{
+		return Misses.GetValue();
+	}
+
+	int64 GetMemoryUsage() const
+	{
+		return MemoryUsage;
+	}
+
+private:
+	struct FEntry
+	{
+		FValuePtr Result;
+		int64 Size;
+		TDoubleLinkedList<FKey>::TDoubleLinkedListNode* LruNode;
+	};
+
+	FCriticalSection CacheLock;
+
+	TMap<FKey, FEntry> Cache;
+	// Most recently used keys at the head
+	TDoubleLinkedList<FKey> LruList;
+
+	TMap<TLazyObjectPtr<URulePackage>, FMD5Hash> RulePackageHashes;
+
+	int64 MemoryBudget;
+	int64 MemoryUsage = 0;
+
+	FThreadSafeCounter Hits;
+	FThreadSafeCounter Misses;
+
+	void EvictLeastRecentlyUsed();
+};
@@ -0,0 +1,81 @@
+/* Copyright 2021 Esri
+ *
+ * Licensed under the Apache License Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "GenerateResultCache.h"
+#include "PRTTypes.h"
+
+#include "HAL/ThreadSafeCounter.h"
+
+/**
+ * Persistent cache which stores serialized generate results on disk so that generating the same inputs in a later session does not
+ * require PRT. Entries are keyed by the same content hash as the FGenerateResultCache and versioned by the plugin and PRT version. Once the
+ * cache exceeds its maximum size the least recently used entries are deleted.
+ */
+class FGenerateResultDiskCache
+{
+public:
+	/**
+	 * \brief Enables the cache. Entries are stored in a subfolder of the given directory which depends on the given version, the folders of
+	 * other versions are deleted.
+	 *
+	 * @param InMaxSize maximum size of all entries in bytes, 0 for no limit
+	 */
+	void Initialize(const FString& InCacheDirectory, const FString& InVersion, int64 InMaxSize);
+
+	bool IsEnabled() const
+	{
+		return !CacheDirectory.IsEmpty();
+	}
+
+	/**
+	 * \return the deserialized result for the given key or nullptr if no valid entry exists.
+	 *
+	 * @param RuleFileInfo rule file info of the loaded rule package. The evaluated attributes of the entry are only restored if it is set.
+	 */
+	VITRUVIO_API FGenerateResultCache::FValuePtr Load(const FGenerateResultCache::FKey& Key, const RuleFileInfoPtr& RuleFileInfo = {}) const;
+
+	/**
+	 * \brief Serializes the given result and stores it on disk. The file is written on a background thread.
+	 */
+	VITRUVIO_API void Store(const FGenerateResultCache::FKey& Key, const FGenerateResultDescription& Result) const;
+
+	/**
+	 * \brief Blocks until all entries passed to Store have been written.
+	 */
+	VITRUVIO_API void Flush() const;
+
+	/**
+	 * \brief Deletes all entries of the current version.
+	 */
+	VITRUVIO_API void Clear() const;
+
+private:
+	FString CacheDirectory;
+	FString Version;
+	int64 MaxSize = 0;
+
+	// Size of all entries, updated by Prune and by every written entry
+	mutable TAtomic<int64> Size {0};
+	mutable FThreadSafeCounter PendingWrites;
+	mutable FCriticalSection PruneLock;
+
+	FString GetEntryPath(const FGenerateResultCache::FKey& Key) const;
+	FGenerateResultCache::FValuePtr Deserialize(TArrayView<const uint8> Data, const RuleFileInfoPtr& RuleFileInfo) const;
+
+	// Determines the size of all entries and deletes the least recently used ones if the maximum size is exceeded
+	void Prune() const;
+};
@@ -0,0 +1,67 @@
+/* Copyright 2021 Esri
+ *
+ * Licensed under the Apache License Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "Engine/AssetUserData.h"
+#include "Interfaces/Interface_CollisionDataProvider.h"
+#include "VitruvioMesh.h"
+
+#include "GeneratedModelCollision.generated.h"
+
+class UBodySetup;
+
+/**
+ * Collision of a generated static mesh. It is attached to the static mesh as asset user data and provides the collision data for cooking the
+ * body setups. The body setups are cooked asynchronously once per mesh and shared by all components which use the mesh.
+ */
+UCLASS()
+class VITRUVIO_API UGeneratedModelCollision : public UAssetUserData, public IInterface_CollisionDataProvider
+{
+	GENERATED_BODY()
+
+	virtual bool GetPhysicsTriMeshData(FTriMeshCollisionData* TriCollisionData, bool InUseAllTriData) override;
+
+	virtual bool ContainsPhysicsTriMeshData(bool InUseAllTriData) const override
+	{
+		return CollisionData.IsValid() && CollisionData->IsValid();
+	}
+
+public:
+	void SetCollisionData(const TSharedPtr<const FCollisionData>& InCollisionData)
+	{
+		CollisionData = InCollisionData;
+	}
+
+	/**
+	 * \brief Returns the body setup for complex (use complex as simple) or simple collision. It is created on first use and cooked on a worker
+	 * thread. Returns nullptr until the cooking has finished.
+	 */
+	UBodySetup* GetBodySetup(bool bComplexCollision);
+
+private:
+	TSharedPtr<const FCollisionData> CollisionData;
+
+	bool bComplexBodySetupCooked = false;
+	bool bSimpleBodySetupCooked = false;
+
+	void FinishPhysicsAsyncCook(bool bSuccess, bool bComplexCollision);
+
+	UPROPERTY(Transient)
+	UBodySetup* ComplexBodySetup = nullptr;
+
+	UPROPERTY(Transient)
+	UBodySetup* SimpleBodySetup = nullptr;
+};
@@ -16,41 +16,32 @@
 #pragma once
 
 #include "Components/HierarchicalInstancedStaticMeshComponent.h"
-#include "Interfaces/Interface_CollisionDataProvider.h"
-#include "VitruvioMesh.h"
 
 #include "GeneratedModelHISMComponent.generated.h"
 
+class UBodySetup;
+
 UCLASS(ClassGroup = (Custom), meta = (BlueprintSpawnableComponent))
-class VITRUVIO_API UGeneratedModelHISMComponent : public UHierarchicalInstancedStaticMeshComponent, public IInterface_CollisionDataProvider
+class VITRUVIO_API UGeneratedModelHISMComponent : public UHierarchicalInstancedStaticMeshComponent
 {
 	GENERATED_BODY()
 
-	virtual bool GetPhysicsTriMeshData(FTriMeshCollisionData* TriCollisionData, bool InUseAllTriData) override
-	{
-		if (!CollisionData.IsValid())
-		{
-			return false;
-		}
-
-		TriCollisionData->Indices = CollisionData.Indices;
-		TriCollisionData->Vertices = CollisionData.Vertices;
-		TriCollisionData->bFlipNormals = true;
-		return true;
-	}
-
-	virtual bool ContainsPhysicsTriMeshData(bool InUseAllTriData) const override
+public:
+	/**
+	 * \brief Sets the cooked body setup used for the collision of this component. The static mesh is shared by all components which use the
+	 * same generated mesh, their collision can differ (see UVitruvioComponent::GenerateCollision).
+	 */
+	void SetCollisionBodySetup(UBodySetup* InBodySetup)
 	{
-		return CollisionData.IsValid();
+		CollisionBodySetup = InBodySetup;
 	}
 
-public:
-	void SetCollisionData(const FCollisionData& InCollisionData)
+	virtual UBodySetup* GetBodySetup() override
 	{
-		CollisionData = InCollisionData;
+		return CollisionBodySetup;
 	}
 
 private:
-	
-	FCollisionData CollisionData;
-};
\ No newline at end of file
+	UPROPERTY(Transient)
+	UBodySetup* CollisionBodySetup = nullptr;
+};
@@ -6,10 +6,23 @@ class FMeshCache
 public:
 	VITRUVIO_API TSharedPtr<FVitruvioMesh> Get(const FString& Uri);
 	VITRUVIO_API TSharedPtr<FVitruvioMesh> InsertOrGet(const FString& Uri, const TSharedPtr<FVitruvioMesh>& Mesh);
+
+	/**
+	 * Meshes without uri (eg. the meshes of initial shapes) are looked up by their content hash (see FVitruvioMesh::GetContentHash). Only
+	 * weak references are kept, so the meshes are released together with the last generate result which uses them. To rule out hash
+	 * collisions the materials, the vertex and triangle counts and the vertex positions (in Unreal space) are compared as well.
+	 */
+	VITRUVIO_API TSharedPtr<FVitruvioMesh> GetByContent(uint64 ContentHash, const TArray<Vitruvio::FMaterialAttributeContainer>& Materials,
+														const FVitruvioMeshStats& Stats, TArrayView<const FVector> Positions);
+	VITRUVIO_API TSharedPtr<FVitruvioMesh> InsertOrGetByContent(const TSharedPtr<FVitruvioMesh>& Mesh);
+
 	VITRUVIO_API void Empty();
 
 private:
 	FCriticalSection MeshCacheCriticalSection;
 
 	TMap<FString, TSharedPtr<FVitruvioMesh>> Cache;
+
+	TMap<uint64, TWeakPtr<FVitruvioMesh>> ContentCache;
+	int32 ContentCachePruneThreshold = 1024;
 };
@@ -20,6 +20,7 @@
 #include "VitruvioModule.h"
 
 #include "CoreMinimal.h"
+#include "HAL/ThreadSafeBool.h"
 #include "InitialShape.h"
 #include "VitruvioTypes.h"
 
@@ -39,6 +40,13 @@ struct FConvertedGenerateResult
 	TArray<FInstance> Instances;
 };
 
+struct FPendingCollision
+{
+	TWeakObjectPtr<UStaticMeshComponent> Component;
+	TSharedPtr<FVitruvioMesh> Mesh;
+	bool bComplexCollision;
+};
+
 struct FAttributesEvaluation
 {
 	FAttributeMapPtr AttributeMap;
@@ -60,6 +68,12 @@ class VITRUVIO_API UVitruvioComponent : public UActorComponent
 
 	bool bNotifyAttributeChange = false;
 
+	bool bEvaluateAttributesOnRegenerate = false;
+
+	/** Set by a canceled generate call which has to be repeated, the regenerate is issued from TickComponent on the game thread. */
+	FThreadSafeBool bRegenerateRequested = false;
+	FThreadSafeBool bRegenerateEvaluateAttributes = false;
+
 public:
 	UVitruvioComponent();
 
@@ -175,6 +189,40 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Vitruvio")
 	URulePackage* GetRpk() const;
 
+	/**
+	 * Access string reports of the generated model. Reports with the same name are summed up over all shapes (the most frequent value for
+	 * strings).
+	 *
+	 * @param Name The name of the string report.
+	 * @param OutValue Set to the reports value if it exists or to an empty String otherwise.
+	 * @returns true if the string report with the given Name exists or false otherwise.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Vitruvio")
+	bool GetStringReport(const FString& Name, FString& OutValue) const;
+
+	/**
+	 * Access bool reports of the generated model. Reports with the same name are summed up over all shapes.
+	 *
+	 * @param Name The name of the bool report.
+	 * @param OutValue Set to the reports value if it exists or to false otherwise.
+	 * @returns true if the bool report with the given Name exists or false otherwise.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Vitruvio")
+	bool GetBoolReport(const FString& Name, bool& OutValue) const;
+
+	/**
+	 * Access float reports of the generated model. Reports with the same name are summed up over all shapes.
+	 *
+	 * @param Name The name of the float report.
+	 * @param OutValue Set to the reports value if it exists or to 0.0f otherwise.
+	 * @returns true if the float report with the given Name exists or false otherwise.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Vitruvio")
+	bool GetFloatReport(const FString& Name, float& OutValue) const;
+
+	/** Returns all reports of the generated model. */
+	const Vitruvio::FReportMap& GetReports() const;
+
 	/**
 	 * Sets the random seed used for generation.
 	 * If GenerateAutomatically is set to true this will automatically trigger a regeneration.
@@ -188,8 +236,14 @@ public:
 	/* Removes the generated meshes from this VitruvioComponent. */
 	void RemoveGeneratedMeshes();
 
+	/*
+	 * Finishes building the meshes of the last received generate result and creates the generated model components right away instead of
+	 * spreading the mesh builds over several frames.
+	 */
+	void FinishPendingBuild();
+
 	/**
-	 * Evaluate rule attributes.
+	 * Evaluate rule attributes. If the component generates afterwards, the attributes are evaluated in the same generate call.
 	 *
 	 * @param ForceRegenerate Whether to force regenerate even if generate automatically is set to false
 	 */
@@ -234,23 +288,52 @@ private:
 	int32 RandomSeed;
 
 	TQueue<FGenerateResultDescription> GenerateQueue;
+
+	/** Generate result whose meshes are currently being built. */
+	TOptional<FGenerateResultDescription> PendingBuildResult;
+
+	/** Generated components whose collision is applied once the physics meshes of their mesh have been cooked. */
+	TArray<FPendingCollision> PendingCollisions;
 	TQueue<FAttributesEvaluation> AttributesEvaluationQueue;
 
 	FGenerateResult::FTokenPtr GenerateToken;
 	FAttributeMapResult::FTokenPtr EvalAttributesInvalidationToken;
 
+	/** Whether a background generate call has been collected for the next batch (see FlushBatchGenerates). */
+	bool bBatchGeneratePending = false;
+	bool bBatchGenerateEvaluateAttributes = false;
+
 	bool HasGeneratedMesh = false;
 
+	/** Reports of the last generated model. */
+	Vitruvio::FReportMap Reports;
+
 	void CalculateRandomSeed();
 
 	void NotifyAttributesChanged();
 
-	void ProcessGenerateQueue();
+	void ProcessGenerateQueue(bool bWaitForBuild = false);
+	void ProcessRegenerateRequest();
 	void ProcessAttributesEvaluationQueue();
+	void ProcessPendingCollisions();
+
+	void UpdateAttributes(const FAttributeMapPtr& AttributeMap);
+
+	void GenerateInternal(bool bEvaluateAttributes);
+	void HandleGenerateResult(FGenerateResult GenerateResult, bool bEvaluateAttributes);
+
+	/** Issues the background generate calls of all components collected in previous frames with a single GenerateBatchAsync call. */
+	static void FlushBatchGenerates();
+
+	void BeginBuildResult(FGenerateResultDescription& GenerateResult,
+						  TMap<Vitruvio::FMaterialAttributeContainer, UMaterialInstanceDynamic*>& MaterialCache,
+						  TMap<FString, Vitruvio::FTextureData>& TextureCache);
+
+	bool FinishBuildResult(FGenerateResultDescription& GenerateResult, bool bWait);
 
-	FConvertedGenerateResult BuildResult(FGenerateResultDescription& GenerateResult,
-										 TMap<Vitruvio::FMaterialAttributeContainer, UMaterialInstanceDynamic*>& MaterialCache,
-										 TMap<FString, Vitruvio::FTextureData>& TextureCache);
+	FConvertedGenerateResult ConvertResult(FGenerateResultDescription& GenerateResult,
+										   TMap<Vitruvio::FMaterialAttributeContainer, UMaterialInstanceDynamic*>& MaterialCache,
+										   TMap<FString, Vitruvio::FTextureData>& TextureCache);
 
 #if WITH_EDITOR
 	FDelegateHandle PropertyChangeDelegate;
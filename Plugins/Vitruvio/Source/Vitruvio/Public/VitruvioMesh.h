@@ -2,6 +2,11 @@
 
 #include "VitruvioTypes.h"
 
+#include "Async/Future.h"
+#include "StaticMeshResources.h"
+
+class UBodySetup;
+
 UMaterialInstanceDynamic* CacheMaterial(UMaterial* OpaqueParent, UMaterial* MaskedParent, UMaterial* TranslucentParent,
 										TMap<FString, Vitruvio::FTextureData>& TextureCache,
 										TMap<Vitruvio::FMaterialAttributeContainer, UMaterialInstanceDynamic*>& MaterialCache,
@@ -18,20 +23,70 @@ struct FCollisionData
 	}
 };
 
+/**
+ * Bounds and element counts of a mesh as determined by the encoder. They are known before the mesh is built and can be used to plan the
+ * build (eg. for memory accounting or choosing culling distances).
+ */
+struct FVitruvioMeshStats
+{
+	FBoxSphereBounds Bounds = FBoxSphereBounds(ForceInit);
+	int32 NumVertices = 0;
+	int32 NumTriangles = 0;
+	int32 NumMaterials = 0;
+
+	friend FArchive& operator<<(FArchive& Ar, FVitruvioMeshStats& Stats)
+	{
+		Ar << Stats.Bounds;
+		Ar << Stats.NumVertices;
+		Ar << Stats.NumTriangles;
+		Ar << Stats.NumMaterials;
+		return Ar;
+	}
+};
+
 class FVitruvioMesh
 {
 	FString Uri;
 
 	FMeshDescription MeshDescription;
 	TArray<Vitruvio::FMaterialAttributeContainer> Materials;
+	FVitruvioMeshStats Stats;
+
+	// Hash of the encoded geometry and materials of meshes without uri, 0 if not set (see FMeshCache::GetByContent)
+	uint64 ContentHash = 0;
 
 	UStaticMesh* StaticMesh;
-	FCollisionData CollisionData;
+
+	// Immutable once the render data has been built, shared with the collision of the static mesh (see UGeneratedModelCollision)
+	TSharedPtr<const FCollisionData> CollisionData;
+
+	// Render data which is built on a worker thread and handed over to the static mesh on the game thread once it is ready
+	TUniquePtr<FStaticMeshRenderData> RenderData;
+	TFuture<void> RenderDataBuild;
+	bool bIsBuilt = false;
+
+#if WITH_EDITORONLY_DATA
+	// Copy of the mesh description for the source model of the static mesh, which is required by editor tools (eg. the Vitruvio cooker)
+	FMeshDescription SourceMeshDescription;
+#endif
+
+	// Computes the render data and collision data, runs on a worker thread
+	void BuildRenderData();
+
+	// Triangle indices provided by triangulated geometry which are used for the collision data instead of extracting them on build
+	TArray<FTriIndices> TriangleIndices;
 
 public:
 	FVitruvioMesh(const FString& Uri, const FMeshDescription& MeshDescription,
-				  const TArray<Vitruvio::FMaterialAttributeContainer>& Materials)
-		: Uri(Uri), MeshDescription(MeshDescription), Materials(Materials), StaticMesh(nullptr)
+				  const TArray<Vitruvio::FMaterialAttributeContainer>& Materials, const FVitruvioMeshStats& Stats)
+		: Uri(Uri), MeshDescription(MeshDescription), Materials(Materials), Stats(Stats), StaticMesh(nullptr)
+	{
+	}
+
+	FVitruvioMesh(const FString& Uri, FMeshDescription&& MeshDescription, const TArray<Vitruvio::FMaterialAttributeContainer>& Materials,
+				  const FVitruvioMeshStats& Stats, TArray<FTriIndices>&& TriangleIndices = TArray<FTriIndices>())
+		: Uri(Uri), MeshDescription(MoveTemp(MeshDescription)), Materials(Materials), Stats(Stats), StaticMesh(nullptr),
+		  TriangleIndices(MoveTemp(TriangleIndices))
 	{
 	}
 
@@ -42,21 +97,78 @@ public:
 		return Uri;
 	}
 
+	const FMeshDescription& GetMeshDescription() const
+	{
+		return MeshDescription;
+	}
+
 	const TArray<Vitruvio::FMaterialAttributeContainer>& GetMaterials() const
 	{
 		return Materials;
 	}
 
+	const FVitruvioMeshStats& GetStats() const
+	{
+		return Stats;
+	}
+
+	uint64 GetContentHash() const
+	{
+		return ContentHash;
+	}
+
+	/**
+	 * \brief Sets the content hash. Has to be called before the mesh is added to the mesh cache.
+	 */
+	void SetContentHash(uint64 InContentHash)
+	{
+		ContentHash = InContentHash;
+	}
+
 	UStaticMesh* GetStaticMesh() const
 	{
 		return StaticMesh;
 	}
 
-	const FCollisionData& GetCollisionData() const
+	const TSharedPtr<const FCollisionData>& GetCollisionData() const
 	{
 		return CollisionData;
 	}
 
+	/**
+	 * \brief Returns the body setup for complex or simple collision of the built static mesh. The body setup is cooked asynchronously once per
+	 * mesh and shared by all components which use the mesh (see UGeneratedModelCollision). Returns nullptr until the cooking has finished.
+	 */
+	UBodySetup* GetBodySetup(bool bComplexCollision) const;
+
+	/**
+	 * \return true if the static mesh has been built and its render resources are initialized.
+	 */
+	bool IsBuilt() const
+	{
+		return bIsBuilt;
+	}
+
+	/**
+	 * \brief Creates the static mesh and its materials and starts building the render and collision data on a worker thread. Does nothing if
+	 * the build has already been started. Has to be called on the game thread.
+	 */
+	void BeginBuild(const FString& Name, TMap<Vitruvio::FMaterialAttributeContainer, UMaterialInstanceDynamic*>& MaterialCache,
+					TMap<FString, Vitruvio::FTextureData>& TextureCache, UMaterial* OpaqueParent, UMaterial* MaskedParent,
+					UMaterial* TranslucentParent);
+
+	/**
+	 * \brief Hands the render data over to the static mesh and initializes its render resources once the worker thread has finished. Has to
+	 * be called on the game thread after BeginBuild.
+	 *
+	 * @param bWait whether to block until the render data has been built.
+	 * \return true if the mesh has been built.
+	 */
+	bool TryFinishBuild(bool bWait = false);
+
+	/**
+	 * \brief Builds the static mesh synchronously (see BeginBuild and TryFinishBuild).
+	 */
 	void Build(const FString& Name, TMap<Vitruvio::FMaterialAttributeContainer, UMaterialInstanceDynamic*>& MaterialCache,
 			   TMap<FString, Vitruvio::FTextureData>& TextureCache, UMaterial* OpaqueParent, UMaterial* MaskedParent, UMaterial* TranslucentParent);
 };
@@ -16,6 +16,8 @@
 #pragma once
 
 #include "AttributeMap.h"
+#include "GenerateResultCache.h"
+#include "GenerateResultDiskCache.h"
 #include "InitialShape.h"
 #include "MeshCache.h"
 #include "MeshDescription.h"
@@ -26,8 +28,10 @@
 #include "prt/Object.h"
 
 #include "HAL/ThreadSafeCounter.h"
+#include "Misc/QueuedThreadPool.h"
 #include "Modules/ModuleManager.h"
 #include "Engine/StaticMesh.h"
+#include "Stats/Stats.h"
 
 #include "UnrealLogHandler.h"
 #include "VitruvioTypes.h"
@@ -38,11 +42,32 @@
 
 DECLARE_LOG_CATEGORY_EXTERN(LogUnrealPrt, Log, All);
 
+DECLARE_STATS_GROUP(TEXT("Vitruvio"), STATGROUP_Vitruvio, STATCAT_Advanced);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Canceled Generate Calls"), STAT_VitruvioCanceledGenerateCalls, STATGROUP_Vitruvio, VITRUVIO_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Generate Result Cache Hits"), STAT_VitruvioGenerateResultCacheHits, STATGROUP_Vitruvio, VITRUVIO_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Generate Result Cache Misses"), STAT_VitruvioGenerateResultCacheMisses, STATGROUP_Vitruvio, VITRUVIO_API);
+DECLARE_MEMORY_STAT_EXTERN(TEXT("Generate Result Cache Memory"), STAT_VitruvioGenerateResultCacheMemory, STATGROUP_Vitruvio, VITRUVIO_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Generate Result Disk Cache Hits"), STAT_VitruvioGenerateResultDiskCacheHits, STATGROUP_Vitruvio, VITRUVIO_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Generate Result Disk Cache Misses"), STAT_VitruvioGenerateResultDiskCacheMisses, STATGROUP_Vitruvio, VITRUVIO_API);
+
 struct FGenerateResultDescription
 {
 	Vitruvio::FInstanceMap Instances;
 	TMap<int32, TSharedPtr<FVitruvioMesh>> Meshes;
 	TMap<int32, FString> Names;
+	Vitruvio::FReportMap Reports;
+
+	// Only set if the attributes have been evaluated together with the geometry
+	FAttributeMapPtr EvaluatedAttributes;
+};
+
+struct FGenerateRequest
+{
+	TArray<FInitialShapeFace> InitialShape;
+	URulePackage* RulePackage = nullptr;
+	AttributeMapUPtr Attributes;
+	int32 RandomSeed = 0;
+	bool bEvaluateAttributes = false;
 };
 
 class FInvalidationToken
@@ -50,6 +75,8 @@ class FInvalidationToken
 public:
 	mutable FCriticalSection Lock;
 
+	virtual ~FInvalidationToken() = default;
+
 	void Invalidate()
 	{
 		FScopeLock InvalidationLock(&Lock);
@@ -61,6 +88,14 @@ public:
 		return bIsInvalid;
 	}
 
+	/**
+	 * \return true if the ongoing work for this token is no longer needed and can be canceled.
+	 */
+	virtual bool IsCancelRequested() const
+	{
+		return IsInvalid();
+	}
+
 private:
 	FThreadSafeBool bIsInvalid = false;
 };
@@ -78,6 +113,11 @@ public:
 		return bRequestReEvaluateAttributes;
 	}
 
+	bool IsCancelRequested() const override
+	{
+		return IsInvalid() || IsReEvaluateRequested();
+	}
+
 private:
 	FThreadSafeBool bRequestReEvaluateAttributes = false;
 };
@@ -95,6 +135,11 @@ public:
 		return bRequestRegenerate;
 	}
 
+	bool IsCancelRequested() const override
+	{
+		return IsInvalid() || IsRegenerateRequested();
+	}
+
 private:
 	FThreadSafeBool bRequestRegenerate = false;
 };
@@ -120,6 +165,21 @@ public:
 using FGenerateResult = TResult<FGenerateResultDescription, FGenerateToken>;
 using FAttributeMapResult = TResult<FAttributeMapPtr, FEvalAttributesToken>;
 
+/**
+ * A loaded rule package. Besides the resolve map it contains the rule file information which is the same for every generate call and
+ * is therefore only computed once per rule package. Shared immutably across threads.
+ */
+struct FRulePackageInfo
+{
+	ResolveMapSPtr ResolveMap;
+	std::wstring RuleFile;
+	std::wstring RuleFileUri;
+	std::wstring StartRule;
+	RuleFileInfoPtr RuleFileInfo;
+};
+
+using FRulePackageInfoPtr = TSharedPtr<const FRulePackageInfo, ESPMode::ThreadSafe>;
+
 class VitruvioModule final : public IModuleInterface, public FGCObject
 {
 	friend class VitruvioEditorModule;
@@ -140,10 +200,26 @@ public:
 	 * \param RulePackage
 	 * \param Attributes
 	 * \param RandomSeed
+	 * \param Priority the priority used to schedule the generate call on the Vitruvio thread pool.
 	 * \return the generated UStaticMesh.
 	 */
 	VITRUVIO_API FGenerateResult GenerateAsync(const TArray<FInitialShapeFace>& InitialShape, URulePackage* RulePackage, AttributeMapUPtr Attributes,
-											   const int32 RandomSeed) const;
+											   const int32 RandomSeed, EQueuedWorkPriority Priority = EQueuedWorkPriority::Normal) const;
+
+	/**
+	 * \brief Asynchronously generate the models and evaluate the rule attributes with the given InitialShape, RulePackage and Attributes in a
+	 * single PRT generate call. The evaluated attributes are returned in FGenerateResultDescription::EvaluatedAttributes.
+	 *
+	 * \param InitialShape
+	 * \param RulePackage
+	 * \param Attributes
+	 * \param RandomSeed
+	 * \param Priority the priority used to schedule the generate call on the Vitruvio thread pool.
+	 * \return the generated UStaticMesh and evaluated attributes.
+	 */
+	VITRUVIO_API FGenerateResult GenerateAndEvaluateRuleAttributesAsync(const TArray<FInitialShapeFace>& InitialShape, URulePackage* RulePackage,
+																		AttributeMapUPtr Attributes, const int32 RandomSeed,
+																		EQueuedWorkPriority Priority = EQueuedWorkPriority::Normal) const;
 
 	/**
 	 * \brief Generate the models with the given InitialShape, RulePackage and Attributes.
@@ -157,6 +233,17 @@ public:
 	VITRUVIO_API FGenerateResultDescription Generate(const TArray<FInitialShapeFace>& InitialShape, URulePackage* RulePackage,
 													 AttributeMapUPtr Attributes, const int32 RandomSeed) const;
 
+	/**
+	 * \brief Asynchronously generate the models for multiple requests. Requests using the same RulePackage are grouped and generated with a
+	 * single PRT generate call per worker thread.
+	 *
+	 * \param Requests
+	 * \param Priority the priority used to schedule the generate calls on the Vitruvio thread pool.
+	 * \return the generate results in the same order as the given requests.
+	 */
+	VITRUVIO_API TArray<FGenerateResult> GenerateBatchAsync(TArray<FGenerateRequest> Requests,
+															EQueuedWorkPriority Priority = EQueuedWorkPriority::Normal) const;
+
 	/**
 	 * \brief Asynchronously evaluates attributes for the given initial shape and rule package.
 	 *
@@ -164,10 +251,12 @@ public:
 	 * \param RulePackage
 	 * \param Attributes
 	 * \param RandomSeed
+	 * \param Priority the priority used to schedule the evaluation on the Vitruvio thread pool.
 	 * \return
 	 */
 	VITRUVIO_API FAttributeMapResult EvaluateRuleAttributesAsync(const TArray<FInitialShapeFace>& InitialShape, URulePackage* RulePackage,
-															 AttributeMapUPtr Attributes, const int32 RandomSeed) const;
+															 AttributeMapUPtr Attributes, const int32 RandomSeed,
+															 EQueuedWorkPriority Priority = EQueuedWorkPriority::Normal) const;
 
 	/**
 	 * \return whether PRT is initialized meaning installed and ready to use. Before initialization generation is not possible and will
@@ -179,11 +268,11 @@ public:
 	}
 
 	/**
-	 * \return true if currently at least one generate call ongoing.
+	 * \return true if currently at least one generate call is ongoing or waiting in the queue.
 	 */
 	VITRUVIO_API bool IsGenerating() const
 	{
-		return GenerateCallsCounter.GetValue() > 0;
+		return GenerateCallsCounter.GetValue() > 0 || GenerateQueueCounter.GetValue() > 0;
 	}
 
 	/**
@@ -195,11 +284,43 @@ public:
 	}
 
 	/**
-	 * \return true if currently at least one RPK is being loaded.
+	 * \return the number of generate calls waiting in the queue for a free worker thread.
+	 */
+	VITRUVIO_API int32 GetNumQueuedGenerateCalls() const
+	{
+		return GenerateQueueCounter.GetValue();
+	}
+
+	/**
+	 * \return the number of generate calls which have been canceled because their result was no longer needed.
+	 */
+	VITRUVIO_API int32 GetNumCanceledGenerateCalls() const
+	{
+		return CanceledGenerateCallsCounter.GetValue();
+	}
+
+	/**
+	 * \return true if currently at least one RPK is being loaded or waiting to be loaded.
 	 */
 	VITRUVIO_API bool IsLoadingRpks() const
 	{
-		return RpkLoadingTasksCounter.GetValue() > 0;
+		return RpkLoadingTasksCounter.GetValue() > 0 || RpkLoadingQueueCounter.GetValue() > 0;
+	}
+
+	/**
+	 * \return the number of RPKs currently being loaded.
+	 */
+	VITRUVIO_API int32 GetNumRpkLoadingTasks() const
+	{
+		return RpkLoadingTasksCounter.GetValue();
+	}
+
+	/**
+	 * \return the number of RPK loading tasks which have been scheduled but not yet started.
+	 */
+	VITRUVIO_API int32 GetNumQueuedRpkLoadingTasks() const
+	{
+		return RpkLoadingQueueCounter.GetValue();
 	}
 
 	/**
@@ -218,6 +339,22 @@ public:
 		return MeshCache;
 	}
 
+	/**
+	 * \returns the cache used for generate results.
+	 */
+	VITRUVIO_API FGenerateResultCache& GetGenerateResultCache()
+	{
+		return GenerateResultCache;
+	}
+
+	/**
+	 * \returns the persistent cache used for generate results.
+	 */
+	VITRUVIO_API FGenerateResultDiskCache& GetGenerateResultDiskCache()
+	{
+		return GenerateResultDiskCache;
+	}
+
 	/**
 	 * \returns the cache used for materials generated by PRT.
 	 */
@@ -226,6 +363,22 @@ public:
 		return TextureCache;
 	}
 
+	/**
+	 * \returns the lock which has to be held while accessing the texture cache since textures are decoded and cached on worker threads.
+	 */
+	VITRUVIO_API FCriticalSection& GetTextureCacheLock() const
+	{
+		return TextureCacheLock;
+	}
+
+	/**
+	 * \return the number of textures currently being decoded or waiting to be decoded.
+	 */
+	VITRUVIO_API int32 GetNumTextureLoadingTasks() const
+	{
+		return TextureLoadingTasksCounter.GetValue();
+	}
+
 	/**
 	 * Registers a generated mesh to keep it from being garbage collected.
 	 */
@@ -236,6 +389,16 @@ public:
 	 */
 	VITRUVIO_API void UnregisterMesh(UStaticMesh* StaticMesh);
 
+	/**
+	 * Starts loading the given rule packages in parallel so that they are ready before the first generate call arrives.
+	 */
+	VITRUVIO_API void PrefetchRulePackages(const TArray<URulePackage*>& RulePackages) const;
+
+	/**
+	 * Prefetches all rule packages referenced by VitruvioComponents in the given world. Called automatically after a map has been loaded.
+	 */
+	VITRUVIO_API void PrefetchRulePackages(UWorld* World) const;
+
 	DECLARE_MULTICAST_DELEGATE_OneParam(FOnGenerateCompleted, int);
 
 	DECLARE_MULTICAST_DELEGATE_TwoParams(FOnAllGenerateCompleted, int, int);
@@ -254,6 +417,12 @@ public:
 	{
 		Collector.AddReferencedObjects(MaterialCache);
 		Collector.AddReferencedObjects(RegisteredMeshes);
+
+		FScopeLock Lock(&TextureCacheLock);
+		for (auto& PathAndTexture : TextureCache)
+		{
+			Collector.AddReferencedObject(PathAndTexture.Value.Texture);
+		}
 	};
 
 	static VitruvioModule& Get()
@@ -268,6 +437,7 @@ public:
 
 private:
 	void* PrtDllHandle = nullptr;
+	void* EncoderDllHandle = nullptr;
 	prt::Object const* PrtLibrary = nullptr;
 	CacheObjectUPtr PrtCache;
 
@@ -275,25 +445,49 @@ private:
 
 	TAtomic<bool> Initialized = false;
 
-	mutable TMap<TLazyObjectPtr<URulePackage>, ResolveMapSPtr> ResolveMapCache;
+	mutable TMap<TLazyObjectPtr<URulePackage>, FRulePackageInfoPtr> ResolveMapCache;
+	mutable TMap<TLazyObjectPtr<URulePackage>, FMD5Hash> ResolveMapHashes;
 	mutable TMap<TLazyObjectPtr<URulePackage>, FGraphEventRef> ResolveMapEventGraphRefCache;
 
 	mutable FCriticalSection LoadResolveMapLock;
 
 	mutable FThreadSafeCounter GenerateCallsCounter;
+	mutable FThreadSafeCounter GenerateQueueCounter;
+	mutable FThreadSafeCounter CanceledGenerateCallsCounter;
 	mutable FThreadSafeCounter RpkLoadingTasksCounter;
+	mutable FThreadSafeCounter RpkLoadingQueueCounter;
 	mutable FThreadSafeCounter LoadAttributesCounter;
+	mutable FThreadSafeCounter TextureLoadingTasksCounter;
+
+	TUniquePtr<FQueuedThreadPool> ThreadPool;
+	TUniquePtr<FQueuedThreadPool> TextureThreadPool;
+
+	FString RpkUnpackFolder;
 
-	FString RpkFolder;
+	FDelegateHandle PostLoadMapHandle;
 
 	TMap<Vitruvio::FMaterialAttributeContainer, UMaterialInstanceDynamic*> MaterialCache;
-	TMap<FString, Vitruvio::FTextureData> TextureCache;
+	mutable TMap<FString, Vitruvio::FTextureData> TextureCache;
+	mutable TMap<FString, FGraphEventRef> TextureLoadEvents;
+	mutable FCriticalSection TextureCacheLock;
 	FMeshCache MeshCache;
+	mutable FGenerateResultCache GenerateResultCache;
+	FGenerateResultDiskCache GenerateResultDiskCache;
 
 	FCriticalSection RegisterMeshLock;
 	TSet<UStaticMesh*> RegisteredMeshes;
 
-	TFuture<ResolveMapSPtr> LoadResolveMapAsync(URulePackage* RulePackage) const;
+	TFuture<FRulePackageInfoPtr> LoadResolveMapAsync(URulePackage* RulePackage) const;
+	void ExecuteWhenRulePackageLoaded(URulePackage* RulePackage, TFunction<void()> Function) const;
+	void OnPostLoadMapWithWorld(UWorld* World) const;
+	// Starts decoding the textures of the given results which are not cached yet and returns the events signaling their completion.
+	FGraphEventArray LoadTexturesAsync(const TArray<FGenerateResultDescription>& Results) const;
+	void ExecuteWhenTexturesLoaded(const TArray<FGenerateResultDescription>& Results, TUniqueFunction<void()> Function) const;
+	FGenerateResult GenerateRequestAsync(FGenerateRequest Request, EQueuedWorkPriority Priority) const;
+	// Expects the caller to have added the number of requests to GenerateCallsCounter. Tokens are optional and used for cancellation.
+	TArray<FGenerateResultDescription> GenerateBatch(TArray<FGenerateRequest>& Requests,
+													 const TArray<FGenerateResult::FTokenPtr>& Tokens = TArray<FGenerateResult::FTokenPtr>()) const;
+	void NotifyGenerateCompleted(int32 GenerateCalls) const;
 	void InitializePrt();
 
 	VITRUVIO_API void EvictFromResolveMapCache(URulePackage* RulePackage);
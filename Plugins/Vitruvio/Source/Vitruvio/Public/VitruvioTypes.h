@@ -35,6 +35,7 @@ struct FMaterialAttributeContainer
 	FString BlendMode;
 	FString Name; // ignored on purpose for hash and equality
 
+	FMaterialAttributeContainer() = default;
 	explicit FMaterialAttributeContainer(const prt::AttributeMap* AttributeMap);
 
 	friend bool operator==(const FMaterialAttributeContainer& Lhs, const FMaterialAttributeContainer& RHS)
@@ -54,6 +55,17 @@ struct FMaterialAttributeContainer
 	}
 
 	friend uint32 GetTypeHash(const FMaterialAttributeContainer& Object);
+
+	friend FArchive& operator<<(FArchive& Ar, FMaterialAttributeContainer& Container)
+	{
+		Ar << Container.TextureProperties;
+		Ar << Container.ColorProperties;
+		Ar << Container.ScalarProperties;
+		Ar << Container.StringProperties;
+		Ar << Container.BlendMode;
+		Ar << Container.Name;
+		return Ar;
+	}
 };
 
 struct FInstanceCacheKey
@@ -63,6 +75,13 @@ struct FInstanceCacheKey
 
 	friend uint32 GetTypeHash(const FInstanceCacheKey& Object);
 
+	friend FArchive& operator<<(FArchive& Ar, FInstanceCacheKey& Key)
+	{
+		Ar << Key.PrototypeId;
+		Ar << Key.MaterialOverrides;
+		return Ar;
+	}
+
 	friend bool operator==(const FInstanceCacheKey& Lhs, const FInstanceCacheKey& RHS)
 	{
 		return Lhs.PrototypeId == RHS.PrototypeId && Lhs.MaterialOverrides == RHS.MaterialOverrides;
@@ -75,6 +94,24 @@ struct FInstanceCacheKey
 };
 using FInstanceMap = TMap<FInstanceCacheKey, TArray<FTransform>>;
 
+/**
+ * CGA reports of an initial shape, summed up over all its shapes.
+ */
+struct FReportMap
+{
+	TMap<FName, bool> BoolReports;
+	TMap<FName, double> FloatReports;
+	TMap<FName, FString> StringReports;
+
+	friend FArchive& operator<<(FArchive& Ar, FReportMap& Reports)
+	{
+		Ar << Reports.BoolReports;
+		Ar << Reports.FloatReports;
+		Ar << Reports.StringReports;
+		return Ar;
+	}
+};
+
 struct FTextureData
 {
 	FTextureData() = default;
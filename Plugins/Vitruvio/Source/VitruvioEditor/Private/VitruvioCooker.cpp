@@ -54,16 +54,21 @@ void BlockUntilCookCompleted()
 	}
 }
 
+int32 GetNumPendingGenerateCalls()
+{
+	return VitruvioModule::Get().GetNumGenerateCalls() + VitruvioModule::Get().GetNumQueuedGenerateCalls();
+}
+
 void BlockUntilGenerated()
 {
 	// Wait until all async generate calls to PRT are finished. We want to block the UI and show a modal progress bar.
-	int32 TotalGenerateCalls = VitruvioModule::Get().GetNumGenerateCalls();
+	int32 TotalGenerateCalls = GetNumPendingGenerateCalls();
 	FScopedSlowTask PRTGenerateCallsTasks(TotalGenerateCalls, FText::FromString("Generating models..."));
 	PRTGenerateCallsTasks.MakeDialog();
 	while (VitruvioModule::Get().IsGenerating() || VitruvioModule::Get().IsLoadingRpks())
 	{
 		FPlatformProcess::Sleep(0); // SwitchToThread
-		int32 CurrentNumGenerateCalls = VitruvioModule::Get().GetNumGenerateCalls();
+		int32 CurrentNumGenerateCalls = GetNumPendingGenerateCalls();
 		PRTGenerateCallsTasks.EnterProgressFrame(TotalGenerateCalls - CurrentNumGenerateCalls);
 		TotalGenerateCalls = CurrentNumGenerateCalls;
 	}
@@ -186,6 +191,8 @@ UStaticMesh* SaveStaticMesh(UStaticMesh* Mesh, const FString& Path, FStaticMeshC
 	PersistedMesh->InitResources();
 
 	FMeshDescription* OriginalMeshDescription = Mesh->GetMeshDescription(0);
+	// Generated meshes have a source model once they are built, see FVitruvioMesh::TryFinishBuild
+	check(OriginalMeshDescription);
 	FMeshDescription NewMeshDescription(*OriginalMeshDescription);
 	FStaticMeshAttributes MeshAttributes(NewMeshDescription);
 
@@ -286,6 +293,10 @@ void CookVitruvioActors(TArray<AActor*> Actors)
 			{
 				continue;
 			}
+
+			// Meshes are built over several frames, make sure the generated model components are up to date
+			VitruvioComponent->FinishPendingBuild();
+
 			AActor* OldAttachParent = Actor->GetAttachParentActor();
 
 			// Spawn new Actor with persisted geometry
@@ -276,9 +276,16 @@ void VitruvioEditorModule::OnPostEngineInit()
 
 void VitruvioEditorModule::OnMapChanged(UWorld* World, EMapChangeType ChangeType)
 {
+	// Editor map loads do not broadcast PostLoadMapWithWorld
+	if (ChangeType == EMapChangeType::LoadMap)
+	{
+		VitruvioModule::Get().PrefetchRulePackages(World);
+	}
+
 	if (ChangeType == EMapChangeType::TearDownWorld)
 	{
 		VitruvioModule::Get().GetMeshCache().Empty();
+		VitruvioModule::Get().GetGenerateResultCache().Empty();
 
 		// Close all open editor of transient meshes generated by Vitruvio to prevent GC issues while loading a new map
 		if (UAssetEditorSubsystem* AssetEditorSubsystem = GEditor->GetEditorSubsystem<UAssetEditorSubsystem>())
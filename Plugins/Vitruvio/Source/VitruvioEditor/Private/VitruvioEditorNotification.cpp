@@ -63,7 +63,16 @@ void FVitruvioEditorNotification::SetNotificationText(const TSharedPtr<SNotifica
 	{
 		if (Vitruvio->IsGenerating())
 		{
-			InNotificationItem->SetText(FText::FromString(FString::Printf(TEXT("Generating %d Models"), Vitruvio->GetNumGenerateCalls())));
+			const int32 NumQueuedGenerateCalls = Vitruvio->GetNumQueuedGenerateCalls();
+			if (NumQueuedGenerateCalls > 0)
+			{
+				InNotificationItem->SetText(FText::FromString(
+					FString::Printf(TEXT("Generating %d Models (%d queued)"), Vitruvio->GetNumGenerateCalls(), NumQueuedGenerateCalls)));
+			}
+			else
+			{
+				InNotificationItem->SetText(FText::FromString(FString::Printf(TEXT("Generating %d Models"), Vitruvio->GetNumGenerateCalls())));
+			}
 		}
 		else if (Vitruvio->IsLoadingRpks())
 		{